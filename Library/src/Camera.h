@@ -40,6 +40,9 @@ namespace dae
 		Matrix viewMatrix{};
 		Matrix projectionMatrix{};
 
+		//goes up every time the view or projection matrix changes
+		uint32_t version{};
+
 		void Initialize(float _fovAngle = 90.f, Vector3 _origin = { 0.f,0.f,0.f }, float _aspectRatio = 16.f/9.f)
 		{
 			fovAngle = _fovAngle;
@@ -138,8 +141,32 @@ namespace dae
 			right = rotationMatrix.TransformVector(Vector3::UnitX);
 			right.Normalize();
 
+			UpdateMatrices();
+		}
+
+		//only bumps the version when something actually moved, so the renderer can keep its vertices
+		void UpdateMatrices()
+		{
+			const Matrix oldViewMatrix{ viewMatrix };
+			const Matrix oldProjectionMatrix{ projectionMatrix };
 			CalculateViewMatrix();
 			CalculateProjectionMatrix();
+			if (HasChanged(viewMatrix, oldViewMatrix) || HasChanged(projectionMatrix, oldProjectionMatrix))
+				++version;
+		}
+
+		//exact, Matrix == allows 1e-6 and a slow camera moves less than that in a frame
+		static bool HasChanged(const Matrix& matrix, const Matrix& oldMatrix)
+		{
+			for (int row{}; row < 4; ++row)
+			{
+				for (int column{}; column < 4; ++column)
+				{
+					if (matrix[row][column] != oldMatrix[row][column])
+						return true;
+				}
+			}
+			return false;
 		}
 		
 
@@ -1,6 +1,10 @@
 #pragma once
 #include "Maths.h"
 #include "vector"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
 
 namespace dae
 {
@@ -11,18 +15,195 @@ namespace dae
 		Vector2 uv{}; //W2
 		Vector3 normal{}; //W4
 		Vector3 tangent{}; //W4
-		Vector3 viewDirection{}; //W4
 	};
 
+	//the same vertices as a Vertex array but one array per component (SoA),
+	//so the vertex stage can load 4/8 vertices at once
+	struct VertexStreams
+	{
+		std::vector<float> positionX{};
+		std::vector<float> positionY{};
+		std::vector<float> positionZ{};
+		std::vector<float> normalX{};
+		std::vector<float> normalY{};
+		std::vector<float> normalZ{};
+		std::vector<float> tangentX{};
+		std::vector<float> tangentY{};
+		std::vector<float> tangentZ{};
+		std::vector<uint32_t> uv{}; //not transformed, already packed the way Vertex_Out stores it (PackHalf2)
+		std::vector<uint32_t> color{}; //same (PackColor)
+
+		size_t Size() const { return positionX.size(); }
+	};
+
+	//which clip planes a vertex is outside of
+	enum ClipFlag : uint8_t
+	{
+		ClipNear = 1 << 0,
+		ClipFar = 1 << 1,
+		ClipLeft = 1 << 2,
+		ClipRight = 1 << 3,
+		ClipBottom = 1 << 4,
+		ClipTop = 1 << 5,
+		ClipGuardBand = 1 << 6,
+
+		ClipFrustum = ClipNear | ClipFar | ClipLeft | ClipRight | ClipBottom | ClipTop,
+		//the screen sides are handled by the raster clamp, only these need actual geometry clipping
+		ClipNeeded = ClipNear | ClipFar | ClipGuardBand
+	};
+
+	//--- packing for Vertex_Out, everything after the vertex stage is read a lot more than it is written ---
+
+	//ieee half, round to nearest even (same as the F16C conversion the AVX2 kernels use), values that are too big become infinity
+	inline uint16_t FloatToHalf(float value)
+	{
+		uint32_t bits{};
+		std::memcpy(&bits, &value, sizeof(bits));
+		const uint32_t sign{ (bits >> 16) & 0x8000 };
+		const int32_t exponent{ int32_t((bits >> 23) & 0xff) - 127 + 15 };
+		uint32_t mantissa{ bits & 0x7fffff };
+
+		if (((bits >> 23) & 0xff) == 0xff)
+			return uint16_t(sign | 0x7c00 | (mantissa != 0 ? 0x200 : 0)); //inf and nan stay what they are
+		if (exponent >= 31)
+			return uint16_t(sign | 0x7c00);
+		if (exponent <= 0)
+		{
+			//denormal, or zero when it is too small for that too
+			if (exponent < -10)
+				return uint16_t(sign);
+			mantissa |= 0x800000;
+			const int shift{ 14 - exponent };
+			const uint32_t half{ mantissa >> shift };
+			const uint32_t halfway{ 1u << (shift - 1) };
+			const uint32_t remainder{ mantissa & ((halfway << 1) - 1) };
+			return uint16_t(sign | (half + uint32_t(remainder > halfway || (remainder == halfway && (half & 1)))));
+		}
+
+		//exactly halfway only rounds up when that makes the result even
+		//a round up that carries into the exponent is still the right value
+		const uint32_t remainder{ mantissa & 0x1fff };
+		const uint32_t roundUp{ uint32_t(remainder > 0x1000 || (remainder == 0x1000 && (mantissa & 0x2000))) };
+		return uint16_t((sign | (uint32_t(exponent) << 10) | (mantissa >> 13)) + roundUp);
+	}
+
+	inline float HalfToFloat(uint16_t half)
+	{
+		const uint32_t sign{ uint32_t(half & 0x8000) << 16 };
+		const uint32_t exponent{ (uint32_t(half) >> 10) & 0x1f };
+		const uint32_t mantissa{ uint32_t(half) & 0x3ff };
+
+		if (exponent == 0)
+		{
+			const float value{ std::ldexp(float(mantissa), -24) };
+			return sign != 0 ? -value : value;
+		}
+
+		const uint32_t bits{ exponent == 31 ? (sign | 0x7f800000 | (mantissa << 13)) : (sign | ((exponent + 112) << 23) | (mantissa << 13)) };
+		float value{};
+		std::memcpy(&value, &bits, sizeof(value));
+		return value;
+	}
+
+	inline uint32_t PackHalf2(const Vector2& value)
+	{
+		return uint32_t(FloatToHalf(value.x)) | (uint32_t(FloatToHalf(value.y)) << 16);
+	}
+
+	inline Vector2 UnpackHalf2(uint32_t packed)
+	{
+		return Vector2{ HalfToFloat(uint16_t(packed & 0xffff)), HalfToFloat(uint16_t(packed >> 16)) };
+	}
+
+	//octahedral encoding: project on the |x|+|y|+|z| = 1 octahedron, fold the bottom half over the top and store x/y as 2 snorm16
+	inline uint32_t PackUnitVector(const Vector3& vector)
+	{
+		auto signNotZero = [](float value) { return value >= 0.f ? 1.f : -1.f; };
+		auto toSnorm16 = [](float value) { return uint32_t(uint16_t(int16_t(std::lround(std::clamp(value, -1.f, 1.f) * 32767.f)))); };
+
+		const float lengthL1{ std::abs(vector.x) + std::abs(vector.y) + std::abs(vector.z) };
+		if (lengthL1 <= 0.f)
+			return 0;
+
+		float u{ vector.x / lengthL1 };
+		float v{ vector.y / lengthL1 };
+		if (vector.z < 0.f)
+		{
+			const float foldedU{ (1.f - std::abs(v)) * signNotZero(u) };
+			v = (1.f - std::abs(u)) * signNotZero(v);
+			u = foldedU;
+		}
+		return toSnorm16(u) | (toSnorm16(v) << 16);
+	}
+
+	inline Vector3 UnpackUnitVector(uint32_t packed)
+	{
+		auto signNotZero = [](float value) { return value >= 0.f ? 1.f : -1.f; };
+
+		float u{ int16_t(packed & 0xffff) / 32767.f };
+		float v{ int16_t(packed >> 16) / 32767.f };
+		const float z{ 1.f - std::abs(u) - std::abs(v) };
+		if (z < 0.f)
+		{
+			const float unfoldedU{ (1.f - std::abs(v)) * signNotZero(u) };
+			v = (1.f - std::abs(u)) * signNotZero(v);
+			u = unfoldedU;
+		}
+		return Vector3{ u, v, z }.Normalized();
+	}
+
+	//rgba8, alpha is always 255
+	inline uint32_t PackColor(const ColorRGB& color)
+	{
+		auto toUnorm8 = [](float value) { return uint32_t(std::clamp(value, 0.f, 1.f) * 255.f + 0.5f); };
+		return toUnorm8(color.r) | (toUnorm8(color.g) << 8) | (toUnorm8(color.b) << 16) | 0xff000000;
+	}
+
+	inline ColorRGB UnpackColor(uint32_t packed)
+	{
+		return ColorRGB{ (packed & 0xff) / 255.f, ((packed >> 8) & 0xff) / 255.f, ((packed >> 16) & 0xff) / 255.f };
+	}
+
+	constexpr uint32_t PackedWhite{ 0xffffffff };
+
+	enum VertexFlag : uint8_t
+	{
+		VertexHasColor = 1 << 0 //color is not white, without it the color is not even read
+	};
+
+	//post-transform vertex, packed to 40 bytes because setup and clipping read these over and over
 	struct Vertex_Out
 	{
 		Vector4 position{};
-		ColorRGB color{ colors::White };
-		Vector2 uv{};
-		Vector3 normal{};
-		Vector3 tangent{};
-		Vector3 viewDirection{};
-		bool valid{ true };
+		uint32_t normal{}; //world space, octahedral (PackUnitVector)
+		uint32_t tangent{}; //same
+		uint32_t uv{}; //2 halves (PackHalf2)
+		uint32_t color{ PackedWhite }; //rgba8 (PackColor), only valid with VertexHasColor
+		uint16_t viewDirection[3]{}; //halves, not normalized because it gets interpolated
+		uint8_t clipFlags{}; //ClipFlag bits, position is still in clip space if any of ClipNeeded is set
+		uint8_t flags{}; //VertexFlag bits
+
+		Vector3 GetNormal() const { return UnpackUnitVector(normal); }
+		Vector3 GetTangent() const { return UnpackUnitVector(tangent); }
+		Vector2 GetUV() const { return UnpackHalf2(uv); }
+		ColorRGB GetColor() const { return (flags & VertexHasColor) != 0 ? UnpackColor(color) : colors::White; }
+		Vector3 GetViewDirection() const { return Vector3{ HalfToFloat(viewDirection[0]), HalfToFloat(viewDirection[1]), HalfToFloat(viewDirection[2]) }; }
+
+		void SetNormal(const Vector3& value) { normal = PackUnitVector(value); }
+		void SetTangent(const Vector3& value) { tangent = PackUnitVector(value); }
+		void SetUV(const Vector2& value) { uv = PackHalf2(value); }
+		void SetPackedColor(uint32_t packed)
+		{
+			color = packed;
+			flags = packed != PackedWhite ? uint8_t(flags | VertexHasColor) : uint8_t(flags & ~VertexHasColor);
+		}
+		void SetColor(const ColorRGB& value) { SetPackedColor(PackColor(value)); }
+		void SetViewDirection(const Vector3& value)
+		{
+			viewDirection[0] = FloatToHalf(value.x);
+			viewDirection[1] = FloatToHalf(value.y);
+			viewDirection[2] = FloatToHalf(value.z);
+		}
 	};
 
 	enum class PrimitiveTopology
@@ -31,13 +212,119 @@ namespace dae
 		TriangleStrip
 	};
 
+	//which side of the triangles gets thrown away before rasterizing
+	enum class CullMode
+	{
+		None,
+		Back,
+		Front
+	};
+
+	//a small piece of a mesh that gets culled as a whole, see Utils::BuildMeshlets
+	struct Meshlet
+	{
+		uint32_t firstVertex{};
+		uint32_t vertexCount{};
+		uint32_t firstTriangle{}; //in Mesh::indices, so its indices start at firstTriangle * 3
+		uint32_t triangleCount{};
+
+		Vector3 center{}; //object space bounding sphere
+		float radius{};
+		Vector3 coneAxis{}; //object space average face normal
+		float coneCutoff{ 1.f }; //sin of the cone half angle, 1 means the normals spread too much to ever cull
+
+		//same meaning as the ones on Mesh, but for just this piece
+		bool isVisible{ true };
+		uint32_t transformedWorldVersion{ UINT32_MAX };
+		uint32_t transformedCameraVersion{ UINT32_MAX };
+	};
+
+	//one more copy of a mesh somewhere else, see Mesh::instances
+	struct MeshInstance
+	{
+		Matrix worldMatrix{};
+		//set by the renderer, same meaning as on Mesh
+		int activeLod{};
+		bool isVisible{ true };
+	};
+
 	struct Mesh
 	{
 		std::vector<Vertex> vertices{};
 		std::vector<uint32_t> indices{};
 		PrimitiveTopology primitiveTopology{ PrimitiveTopology::TriangleStrip };
+		CullMode cullMode{ CullMode::Back };
+		//optional (triangle lists only), empty means the mesh is only culled as a whole
+		std::vector<Meshlet> meshlets{};
+
+		//coarser versions of this mesh (Utils::BuildLodChain), each with about half the triangles of the one before
+		std::vector<Mesh> lods{};
+		float lodError{}; //object space distance this lod is off from the full mesh, 0 for the full mesh
+		int activeLod{}; //picked by the renderer every frame, 0 draws this mesh and n draws lods[n - 1]
+
+		//built from vertices by the renderer, rebuilt when the vertex count changes
+		VertexStreams vertexStreams{};
+
+		//world space position/normal/tangent, only redone when worldVersion changes
+		VertexStreams worldStreams{};
 
 		std::vector<Vertex_Out> vertices_out{};
 		Matrix worldMatrix{};
+		//bump this (or use SetWorldMatrix) after touching worldMatrix, otherwise the cached vertices are used
+		uint32_t worldVersion{};
+
+		//versions vertices_out was made with, the vertex stage skips the mesh when both still match
+		uint32_t transformedWorldVersion{ UINT32_MAX };
+		uint32_t transformedCameraVersion{ UINT32_MAX };
+
+		//object space bounds, call CalculateBounds after filling vertices
+		Vector3 boundsMin{};
+		Vector3 boundsMax{};
+		Vector3 boundsCenter{};
+		float boundsRadius{};
+
+		//set by the renderer every frame, false when the bounds are completely outside the camera frustum
+		bool isVisible{ true };
+
+		//every instance draws the mesh once more with its own world matrix, the vertex data is shared
+		//worldMatrix is not used while there are instances
+		std::vector<MeshInstance> instances{};
+
+		Mesh& GetLod(int lod) { return lod == 0 ? *this : lods[lod - 1]; }
+		const Mesh& GetLod(int lod) const { return lod == 0 ? *this : lods[lod - 1]; }
+		Mesh& GetActiveLod() { return GetLod(activeLod); }
+		const Mesh& GetActiveLod() const { return GetLod(activeLod); }
+
+		void SetWorldMatrix(const Matrix& matrix)
+		{
+			worldMatrix = matrix;
+			++worldVersion;
+		}
+
+		void CalculateBounds()
+		{
+			if (vertices.empty())
+			{
+				boundsMin = boundsMax = boundsCenter = Vector3{};
+				boundsRadius = 0.f;
+				return;
+			}
+
+			boundsMin = boundsMax = vertices[0].position;
+			for (const Vertex& vertex : vertices)
+			{
+				boundsMin = Vector3{ std::min(boundsMin.x, vertex.position.x), std::min(boundsMin.y, vertex.position.y), std::min(boundsMin.z, vertex.position.z) };
+				boundsMax = Vector3{ std::max(boundsMax.x, vertex.position.x), std::max(boundsMax.y, vertex.position.y), std::max(boundsMax.z, vertex.position.z) };
+			}
+
+			//sphere around the box center, but only as big as the farthest vertex (tighter than half the diagonal)
+			boundsCenter = (boundsMin + boundsMax) * 0.5f;
+			float sqrRadius{};
+			for (const Vertex& vertex : vertices)
+			{
+				sqrRadius = std::max(sqrRadius, (vertex.position - boundsCenter).SqrMagnitude());
+			}
+			boundsRadius = std::sqrt(sqrRadius);
+		}
 	};
 }
@@ -1,47 +1,166 @@
 #include "Texture.h"
-#include "Vector2.h"
 #include <cassert>
+#include <cstring>
+#include <iostream>
 #include <SDL_image.h>
 
 namespace dae
 {
-	Texture::Texture(SDL_Surface* pSurface) :
-		m_pSurface{ pSurface },
-		m_pSurfacePixels{ (uint32_t*)pSurface->pixels }
+	Texture::Texture(SDL_Surface* pSurface)
 	{
+		//the surface is row by row in whatever format the file had, decode it to rgba8 and swizzle it into blocks
+		MipLevel firstLevel{ CreateMipLevel(pSurface->w, pSurface->h) };
+		const int bytesPerPixel{ pSurface->format->BytesPerPixel };
+		for (int y{}; y < firstLevel.height; ++y)
+		{
+			const uint8_t* pSurfaceRow{ static_cast<const uint8_t*>(pSurface->pixels) + y * pSurface->pitch };
+			for (int x{}; x < firstLevel.width; ++x)
+			{
+				uint32_t pixel{};
+				std::memcpy(&pixel, pSurfaceRow + x * bytesPerPixel, bytesPerPixel);
+
+				uint8_t r{}, g{}, b{}, a{};
+				SDL_GetRGBA(pixel, pSurface->format, &r, &g, &b, &a);
+				GetTexelRef(firstLevel, x, y) = r | (g << 8) | (b << 16) | (uint32_t(a) << 24);
+			}
+		}
+		m_MipLevels.push_back(firstLevel);
+
+		BuildMipChain();
 	}
 
 	Texture::~Texture()
 	{
-		if (m_pSurface)	
+		for (MipLevel& level : m_MipLevels)
 		{
-			SDL_FreeSurface(m_pSurface);
-			m_pSurface = nullptr;
+			delete[] level.pBlocks;
 		}
 	}
 
 	Texture* Texture::LoadFromFile(const std::string& path)
 	{
-		//TODO
-		//Load SDL_Surface using IMG_LOAD
-		//Create & Return a new Texture Object (using SDL_Surface)
 		SDL_Surface* newSurfaceFromFile{ IMG_Load(path.c_str()) };
 		
-		if (newSurfaceFromFile == nullptr) return nullptr;		
+		if (newSurfaceFromFile == nullptr)
+		{
+			std::cerr << "Texture: could not load " << path << " (" << IMG_GetError() << ")" << std::endl;
+			return nullptr;
+		}
 		
-		return new Texture{ newSurfaceFromFile };	
+		//the texture decodes everything it needs, the surface is not used after this
+		Texture* pTexture{ new Texture{ newSurfaceFromFile } };
+		SDL_FreeSurface(newSurfaceFromFile);
+		return pTexture;
+	}
+
+	Texture::MipLevel Texture::CreateMipLevel(int width, int height)
+	{
+		const int blocksPerRow{ (width + m_BlockSize - 1) / m_BlockSize };
+		const int blocksPerColumn{ (height + m_BlockSize - 1) / m_BlockSize };
+		return MipLevel{ width, height, blocksPerRow, new TexelBlock[size_t(blocksPerRow) * blocksPerColumn]{} };
 	}
 
-	ColorRGB Texture::Sample(const Vector2& uv) const
+	Texture* Texture::Pack(const ChannelSource (&sources)[4])
 	{
-		//TODO
-		//Sample the correct texel for the given uv
-		int x{ static_cast<int>(uv.x * m_pSurface->w) };
-		int y{ static_cast<int>(uv.y * m_pSurface->h) };
-		uint32_t pixelIdx{ static_cast<uint32_t>(x + (y * m_pSurface->w)) };
-		uint8_t r{}, g{}, b{}; //don't ever do this with pointer types
-		SDL_GetRGB(m_pSurfacePixels[pixelIdx], m_pSurface->format, &r, &g, &b);
-
-		return { r / 255.f,g / 255.f,b / 255.f };
+		//size comes from the first real source, the others have to match it
+		//only One goes without a texture, a missing one anywhere else is a failed load and not a white channel
+		const MipLevel* pSize{};
+		for (int channelIdx{}; channelIdx < 4; ++channelIdx)
+		{
+			const ChannelSource& source{ sources[channelIdx] };
+			if (source.channel == Channel::One)
+				continue;
+
+			if (!source.pTexture)
+			{
+				std::cerr << "Texture::Pack: no texture for channel " << channelIdx << std::endl;
+				return nullptr;
+			}
+
+			const MipLevel& sourceLevel{ source.pTexture->m_MipLevels[0] };
+			if (!pSize)
+			{
+				pSize = &sourceLevel;
+			}
+			else if (sourceLevel.width != pSize->width || sourceLevel.height != pSize->height)
+			{
+				std::cerr << "Texture::Pack: channel " << channelIdx << " is " << sourceLevel.width << "x" << sourceLevel.height
+					<< ", the ones before it are " << pSize->width << "x" << pSize->height << std::endl;
+				return nullptr;
+			}
+		}
+		if (!pSize)
+		{
+			std::cerr << "Texture::Pack: every channel is One, there is no size to take" << std::endl;
+			return nullptr;
+		}
+
+		Texture* pTexture{ new Texture{} };
+		MipLevel firstLevel{ CreateMipLevel(pSize->width, pSize->height) };
+		for (int y{}; y < firstLevel.height; ++y)
+		{
+			for (int x{}; x < firstLevel.width; ++x)
+			{
+				uint32_t texel{};
+				for (int channelIdx{}; channelIdx < 4; ++channelIdx)
+				{
+					const ChannelSource& source{ sources[channelIdx] };
+					uint32_t value{ 255 };
+					if (source.channel != Channel::One)
+					{
+						const uint32_t sourceTexel{ GetTexelRef(source.pTexture->m_MipLevels[0], x, y) };
+						if (source.channel == Channel::AverageRGB)
+							value = ((sourceTexel & 0xFF) + ((sourceTexel >> 8) & 0xFF) + ((sourceTexel >> 16) & 0xFF) + 1) / 3;
+						else
+							value = (sourceTexel >> (int(source.channel) * 8)) & 0xFF;
+					}
+					texel |= value << (channelIdx * 8);
+				}
+				GetTexelRef(firstLevel, x, y) = texel;
+			}
+		}
+		pTexture->m_MipLevels.push_back(firstLevel);
+
+		pTexture->BuildMipChain();
+		return pTexture;
+	}
+
+	void Texture::BuildMipChain()
+	{
+		//box filter, odd sizes just repeat the last row/column
+		while (m_MipLevels.back().width > 1 || m_MipLevels.back().height > 1)
+		{
+			const MipLevel source{ m_MipLevels.back() };
+			const MipLevel level{ CreateMipLevel(std::max(source.width / 2, 1), std::max(source.height / 2, 1)) };
+
+			for (int y{}; y < level.height; ++y)
+			{
+				for (int x{}; x < level.width; ++x)
+				{
+					uint32_t sum[4]{};
+					for (int sampleIdx{}; sampleIdx < 4; ++sampleIdx)
+					{
+						const int sourceX{ std::min(x * 2 + sampleIdx % 2, source.width - 1) };
+						const int sourceY{ std::min(y * 2 + sampleIdx / 2, source.height - 1) };
+						const uint32_t texel{ GetTexelRef(source, sourceX, sourceY) };
+						for (int channel{}; channel < 4; ++channel)
+						{
+							sum[channel] += (texel >> (channel * 8)) & 0xFF;
+						}
+					}
+
+					//+ 2 rounds instead of always going down, otherwise every level gets a bit darker
+					uint32_t texel{};
+					for (int channel{}; channel < 4; ++channel)
+					{
+						texel |= ((sum[channel] + 2) / 4) << (channel * 8);
+					}
+					GetTexelRef(level, x, y) = texel;
+				}
+			}
+			m_MipLevels.push_back(level);
+		}
+
+		m_IsPowerOfTwo = std::has_single_bit(uint32_t(m_MipLevels[0].width)) && std::has_single_bit(uint32_t(m_MipLevels[0].height));
 	}
 }
\ No newline at end of file
@@ -1,24 +1,329 @@
 #pragma once
-#include <SDL_surface.h>
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cmath>
+#include <cstdint>
 #include <string>
+#include <vector>
 #include "ColorRGB.h"
+#include "Vector2.h"
+
+struct SDL_Surface;
 
 namespace dae
 {
-	struct Vector2;
+	//Point and Bilinear stay in the closest mip level, Trilinear blends the two levels around the footprint
+	enum class SampleMode
+	{
+		Point,
+		Bilinear,
+		Trilinear
+	};
 
+	//what happens to uv outside [0, 1]: repeat, stick to the edge texel or repeat mirrored every other time
+	enum class AddressMode
+	{
+		Wrap,
+		Clamp,
+		Mirror
+	};
+
+	//rgb plus alpha, for textures that keep something in there (see Texture::Pack)
+	struct ColorRGBA
+	{
+		ColorRGB rgb;
+		float a;
+
+		static ColorRGBA Lerp(const ColorRGBA& c1, const ColorRGBA& c2, float factor)
+		{
+			return { ColorRGB::Lerp(c1.rgb, c2.rgb, factor), Lerpf(c1.a, c2.a, factor) };
+		}
+	};
+
+	//SDL is only used to load, after that the texels are our own rgba8 and sampling is all inline down here
 	class Texture
 	{
 	public:
+		enum class Channel
+		{
+			R,
+			G,
+			B,
+			A,
+			AverageRGB, //for maps that are grey in all but name
+			One //nothing to put there
+		};
+		//where one channel of a packed texture comes from
+		struct ChannelSource
+		{
+			const Texture* pTexture;
+			Channel channel;
+		};
+
 		~Texture();
 
+		//the mip levels own their blocks, a copy would free them twice
+		Texture(const Texture&) = delete;
+		Texture(Texture&&) noexcept = delete;
+		Texture& operator=(const Texture&) = delete;
+		Texture& operator=(Texture&&) noexcept = delete;
+
 		static Texture* LoadFromFile(const std::string& path);
+		//new texture with every channel taken from a channel of another one (all the same size), so one fetch gets all of them
+		//only Channel::One can go without a texture, a missing texture or a size that does not match gives nullptr (and says why)
+		static Texture* Pack(const ChannelSource (&sources)[4]);
+
+		//full resolution, nearest texel
 		ColorRGB Sample(const Vector2& uv) const;
+		//uvDx and uvDy are how much the uv changes to the next pixel right and down, they pick the mip level
+		ColorRGB Sample(const Vector2& uv, const Vector2& uvDx, const Vector2& uvDy) const;
+		//picks the modes on every call, loops over a lot of pixels should use SampleWith through DispatchSampleModes instead
+		ColorRGBA SampleRGBA(const Vector2& uv, const Vector2& uvDx, const Vector2& uvDy) const;
+		//every mode combination is its own instantiation that never branches on the modes, so it inlines into the caller
+		//isPowerOfTwo has to be false for textures that are not (see IsPowerOfTwo), the other way around is only slower
+		template<SampleMode sampleMode, AddressMode addressMode, bool isPowerOfTwo>
+		ColorRGBA SampleWith(const Vector2& uv, const Vector2& uvDx, const Vector2& uvDy) const;
+		//calls function.template operator()<sampleMode, addressMode, isPowerOfTwo>() for the given modes,
+		//so a whole loop of SampleWith calls pays for one switch instead of one per sample
+		template<typename Function>
+		static decltype(auto) DispatchSampleModes(SampleMode sampleMode, AddressMode addressMode, bool isPowerOfTwo, Function&& function);
+
+		void SetSampleMode(SampleMode sampleMode) { m_SampleMode = sampleMode; }
+		SampleMode GetSampleMode() const { return m_SampleMode; }
+		void SetAddressMode(AddressMode addressMode) { m_AddressMode = addressMode; }
+		AddressMode GetAddressMode() const { return m_AddressMode; }
+		bool IsPowerOfTwo() const { return m_IsPowerOfTwo; }
+
+		//texel for a coordinate that can be anywhere, like floor(uv * size) for a uv outside [0, 1]
+		//power of two sizes (every level of a power of two texture is one) wrap and mirror with a mask instead of a modulo
+		template<AddressMode addressMode, bool isPowerOfTwo>
+		static int AddressTexel(int coordinate, int size);
 
 	private:
+		//the unit tests check the block layout against the surface through this (Unit_Tests/test.cpp)
+		friend class TextureTest;
+
+		Texture() = default;
 		Texture(SDL_Surface* pSurface);
 
-		SDL_Surface* m_pSurface{ nullptr };
-		uint32_t* m_pSurfacePixels{ nullptr };
+		//4x4 texels in one 64 byte cache line, so a footprint going any direction stays in as few lines as possible
+		static constexpr int m_BlockSize{ 4 };
+		struct alignas(64) TexelBlock
+		{
+			uint32_t texels[m_BlockSize * m_BlockSize]; //row by row inside the block, r in the lowest byte and a in the highest
+		};
+
+		//level 0 is the surface, every next one is half the size down to 1x1
+		//blocks are row by row, the last ones in a row or column hang over the edge when the size is not a multiple of 4
+		struct MipLevel
+		{
+			int width;
+			int height;
+			int blocksPerRow;
+			TexelBlock* pBlocks;
+		};
+
+		//byte to 0-1 float, a load instead of a convert and a divide
+		static constexpr std::array<float, 256> m_ByteToFloat{ [] {
+			std::array<float, 256> table{};
+			for (int value{}; value < 256; ++value)
+			{
+				table[value] = value / 255.f;
+			}
+			return table;
+		}() };
+
+		static MipLevel CreateMipLevel(int width, int height);
+		static uint32_t& GetTexelRef(const MipLevel& level, int x, int y);
+
+		//everything below level 0, also sets m_IsPowerOfTwo since it knows the size
+		void BuildMipChain();
+		float CalculateMipLevel(const Vector2& uvDx, const Vector2& uvDy) const;
+		static ColorRGBA GetTexel(const MipLevel& level, int x, int y);
+		template<AddressMode addressMode, bool isPowerOfTwo>
+		static ColorRGBA SamplePoint(const MipLevel& level, const Vector2& uv);
+		template<AddressMode addressMode, bool isPowerOfTwo>
+		static ColorRGBA SampleBilinear(const MipLevel& level, const Vector2& uv);
+
+		std::vector<MipLevel> m_MipLevels{};
+		bool m_IsPowerOfTwo{};
+		SampleMode m_SampleMode{ SampleMode::Trilinear };
+		AddressMode m_AddressMode{ AddressMode::Wrap };
 	};
+
+	inline ColorRGB Texture::Sample(const Vector2& uv) const
+	{
+		//not used per pixel, so picking the addressing here is fine
+		const MipLevel& level{ m_MipLevels[0] };
+		switch (m_AddressMode)
+		{
+		case AddressMode::Clamp:
+			return SamplePoint<AddressMode::Clamp, false>(level, uv).rgb;
+		case AddressMode::Mirror:
+			return SamplePoint<AddressMode::Mirror, false>(level, uv).rgb;
+		case AddressMode::Wrap:
+		default:
+			return SamplePoint<AddressMode::Wrap, false>(level, uv).rgb;
+		}
+	}
+
+	inline ColorRGB Texture::Sample(const Vector2& uv, const Vector2& uvDx, const Vector2& uvDy) const
+	{
+		return SampleRGBA(uv, uvDx, uvDy).rgb;
+	}
+
+	template<typename Function>
+	decltype(auto) Texture::DispatchSampleModes(SampleMode sampleMode, AddressMode addressMode, bool isPowerOfTwo, Function&& function)
+	{
+		//one mode at a time, each level turns one more runtime value into a template argument
+		auto withAddressMode = [&]<SampleMode knownSampleMode>() -> decltype(auto)
+			{
+				auto withPowerOfTwo = [&]<AddressMode knownAddressMode>() -> decltype(auto)
+					{
+						if (isPowerOfTwo)
+							return function.template operator()<knownSampleMode, knownAddressMode, true>();
+						return function.template operator()<knownSampleMode, knownAddressMode, false>();
+					};
+
+				switch (addressMode)
+				{
+				case AddressMode::Clamp:
+					return withPowerOfTwo.template operator()<AddressMode::Clamp>();
+				case AddressMode::Mirror:
+					return withPowerOfTwo.template operator()<AddressMode::Mirror>();
+				case AddressMode::Wrap:
+				default:
+					return withPowerOfTwo.template operator()<AddressMode::Wrap>();
+				}
+			};
+
+		switch (sampleMode)
+		{
+		case SampleMode::Point:
+			return withAddressMode.template operator()<SampleMode::Point>();
+		case SampleMode::Bilinear:
+			return withAddressMode.template operator()<SampleMode::Bilinear>();
+		case SampleMode::Trilinear:
+		default:
+			return withAddressMode.template operator()<SampleMode::Trilinear>();
+		}
+	}
+
+	inline ColorRGBA Texture::SampleRGBA(const Vector2& uv, const Vector2& uvDx, const Vector2& uvDy) const
+	{
+		return DispatchSampleModes(m_SampleMode, m_AddressMode, m_IsPowerOfTwo, [&]<SampleMode sampleMode, AddressMode addressMode, bool isPowerOfTwo>()
+			{
+				return SampleWith<sampleMode, addressMode, isPowerOfTwo>(uv, uvDx, uvDy);
+			});
+	}
+
+	template<SampleMode sampleMode, AddressMode addressMode, bool isPowerOfTwo>
+	ColorRGBA Texture::SampleWith(const Vector2& uv, const Vector2& uvDx, const Vector2& uvDy) const
+	{
+		const int lastLevel{ int(m_MipLevels.size()) - 1 };
+		const float mipLevel{ std::clamp(CalculateMipLevel(uvDx, uvDy), 0.f, float(lastLevel)) };
+
+		if constexpr (sampleMode == SampleMode::Point)
+		{
+			return SamplePoint<addressMode, isPowerOfTwo>(m_MipLevels[int(mipLevel + 0.5f)], uv);
+		}
+		else if constexpr (sampleMode == SampleMode::Bilinear)
+		{
+			return SampleBilinear<addressMode, isPowerOfTwo>(m_MipLevels[int(mipLevel + 0.5f)], uv);
+		}
+		else
+		{
+			//a 1x1 texture blends its only level with itself
+			const int level{ std::min(int(mipLevel), std::max(lastLevel - 1, 0)) };
+			const int nextLevel{ std::min(level + 1, lastLevel) };
+			const float factor{ mipLevel - level };
+			return ColorRGBA::Lerp(SampleBilinear<addressMode, isPowerOfTwo>(m_MipLevels[level], uv), SampleBilinear<addressMode, isPowerOfTwo>(m_MipLevels[nextLevel], uv), factor);
+		}
+	}
+
+	inline uint32_t& Texture::GetTexelRef(const MipLevel& level, int x, int y)
+	{
+		//unsigned so the divisions are shifts and masks
+		const uint32_t blockX{ uint32_t(x) / m_BlockSize }, blockY{ uint32_t(y) / m_BlockSize };
+		TexelBlock& block{ level.pBlocks[blockY * level.blocksPerRow + blockX] };
+		return block.texels[(uint32_t(y) % m_BlockSize) * m_BlockSize + uint32_t(x) % m_BlockSize];
+	}
+
+	inline float Texture::CalculateMipLevel(const Vector2& uvDx, const Vector2& uvDy) const
+	{
+		//longest side of the pixel footprint in texels, every doubling is one level further
+		const float width{ float(m_MipLevels[0].width) };
+		const float height{ float(m_MipLevels[0].height) };
+		const float sqrLengthX{ Vector2{ uvDx.x * width, uvDx.y * height }.SqrMagnitude() };
+		const float sqrLengthY{ Vector2{ uvDy.x * width, uvDy.y * height }.SqrMagnitude() };
+
+		//log2 of the squared length is twice the level, the max keeps log2 away from 0 (level -64 still clamps to 0)
+		return 0.5f * std::log2(std::max(std::max(sqrLengthX, sqrLengthY), 1e-38f));
+	}
+
+	template<AddressMode addressMode, bool isPowerOfTwo>
+	int Texture::AddressTexel(int coordinate, int size)
+	{
+		if constexpr (addressMode == AddressMode::Clamp)
+		{
+			return std::clamp(coordinate, 0, size - 1);
+		}
+		else if constexpr (addressMode == AddressMode::Wrap)
+		{
+			//the mask also gets negative coordinates right, the modulo needs the extra add to get there
+			if constexpr (isPowerOfTwo)
+				return coordinate & (size - 1);
+			else
+				return (coordinate % size + size) % size;
+		}
+		else
+		{
+			//wrap over two sizes, the second half counts back down
+			const int period{ size * 2 };
+			int wrapped{};
+			if constexpr (isPowerOfTwo)
+				wrapped = coordinate & (period - 1);
+			else
+				wrapped = (coordinate % period + period) % period;
+			return std::min(wrapped, period - 1 - wrapped);
+		}
+	}
+
+	inline ColorRGBA Texture::GetTexel(const MipLevel& level, int x, int y)
+	{
+		const uint32_t texel{ GetTexelRef(level, x, y) };
+		return { { m_ByteToFloat[texel & 0xFF], m_ByteToFloat[(texel >> 8) & 0xFF], m_ByteToFloat[(texel >> 16) & 0xFF] }, m_ByteToFloat[texel >> 24] };
+	}
+
+	template<AddressMode addressMode, bool isPowerOfTwo>
+	ColorRGBA Texture::SamplePoint(const MipLevel& level, const Vector2& uv)
+	{
+		//the texel the uv falls in, no filtering
+		const int x{ AddressTexel<addressMode, isPowerOfTwo>(int(std::floor(uv.x * level.width)), level.width) };
+		const int y{ AddressTexel<addressMode, isPowerOfTwo>(int(std::floor(uv.y * level.height)), level.height) };
+		return GetTexel(level, x, y);
+	}
+
+	template<AddressMode addressMode, bool isPowerOfTwo>
+	ColorRGBA Texture::SampleBilinear(const MipLevel& level, const Vector2& uv)
+	{
+		//texel centers sit on the halves, so the four around uv start half a texel back
+		const float texelX{ uv.x * level.width - 0.5f };
+		const float texelY{ uv.y * level.height - 0.5f };
+		const float floorX{ std::floor(texelX) };
+		const float floorY{ std::floor(texelY) };
+		const float factorX{ texelX - floorX };
+		const float factorY{ texelY - floorY };
+
+		//the neighbours over the edge follow the address mode too
+		const int x0{ AddressTexel<addressMode, isPowerOfTwo>(int(floorX), level.width) };
+		const int y0{ AddressTexel<addressMode, isPowerOfTwo>(int(floorY), level.height) };
+		const int x1{ AddressTexel<addressMode, isPowerOfTwo>(int(floorX) + 1, level.width) };
+		const int y1{ AddressTexel<addressMode, isPowerOfTwo>(int(floorY) + 1, level.height) };
+
+		const ColorRGBA top{ ColorRGBA::Lerp(GetTexel(level, x0, y0), GetTexel(level, x1, y0), factorX) };
+		const ColorRGBA bottom{ ColorRGBA::Lerp(GetTexel(level, x0, y1), GetTexel(level, x1, y1), factorX) };
+		return ColorRGBA::Lerp(top, bottom, factorY);
+	}
 }
\ No newline at end of file
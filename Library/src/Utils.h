@@ -1,18 +1,853 @@
 #pragma once
 #include <cassert>
 #include <fstream>
+#include <iostream>
+#include <map>
+#include <queue>
+#include <tuple>
+#include <unordered_map>
 #include "Maths.h"
 #include "DataTypes.h"
 
 //#define DISABLE_OBJ
+//prints what the mesh processing did (weld, vertex cache, lods, meshlets) and which kernels the renderer picked, the tests call these a lot
+//#define PRINT_STATS
 
 namespace dae
 {
 	namespace Utils
 	{
-		//Just parses vertices and indices
+		//the v/vt/vn indices of one face corner, corners with the same ones are the same vertex
+		struct OBJVertexKey
+		{
+			size_t position;
+			size_t texCoord;
+			size_t normal;
+
+			bool operator==(const OBJVertexKey& other) const
+			{
+				return position == other.position && texCoord == other.texCoord && normal == other.normal;
+			}
+		};
+
+		struct OBJVertexKeyHash
+		{
+			size_t operator()(const OBJVertexKey& key) const
+			{
+				//boost style hash_combine
+				size_t hash{ std::hash<size_t>{}(key.position) };
+				hash ^= std::hash<size_t>{}(key.texCoord) + 0x9e3779b9 + (hash << 6) + (hash >> 2);
+				hash ^= std::hash<size_t>{}(key.normal) + 0x9e3779b9 + (hash << 6) + (hash >> 2);
+				return hash;
+			}
+		};
+
 #pragma warning(push)
 #pragma warning(disable : 4505) //Warning unreferenced local function
+		//average cache miss ratio: vertices a fifo post-transform cache of cacheSize has to (re)transform per triangle
+		//1 per triangle is about the worst a mesh gets, 0.5 is the best a big regular grid can do
+		static float CalculateACMR(const std::vector<uint32_t>& indices, size_t numVertices, int cacheSize = 16)
+		{
+			if (indices.size() < 3)
+				return 0.f;
+
+			//a vertex is in a fifo cache when it went in less than cacheSize misses ago
+			std::vector<int64_t> insertedAt(numVertices, -int64_t(cacheSize) - 1);
+			int64_t numMisses{};
+			for (uint32_t index : indices)
+			{
+				if (numMisses - insertedAt[index] > cacheSize)
+				{
+					insertedAt[index] = numMisses;
+					++numMisses;
+				}
+			}
+			return float(numMisses) / (indices.size() / 3);
+		}
+
+		//Tipsify (Sander, Nehab, Barczak 2007): reorders a triangle list so the post-transform cache hits more often.
+		//Fans around one vertex at a time and picks the next one that is still in the cache, linear in the triangle count.
+		//Every triangle keeps its own vertex order so the winding does not change.
+		static void OptimizeVertexCache(std::vector<uint32_t>& indices, size_t numVertices, int cacheSize = 16)
+		{
+			const size_t numTriangles{ indices.size() / 3 };
+			if (numTriangles == 0)
+				return;
+
+			//triangles per vertex, as one flat array with offsets
+			std::vector<uint32_t> liveTriangles(numVertices);
+			for (uint32_t index : indices)
+			{
+				++liveTriangles[index];
+			}
+			std::vector<size_t> adjacencyOffsets(numVertices + 1);
+			for (size_t vertexIdx{}; vertexIdx < numVertices; ++vertexIdx)
+			{
+				adjacencyOffsets[vertexIdx + 1] = adjacencyOffsets[vertexIdx] + liveTriangles[vertexIdx];
+			}
+			std::vector<uint32_t> adjacency(adjacencyOffsets.back());
+			std::vector<size_t> adjacencyFill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+			for (size_t indexIdx{}; indexIdx < numTriangles * 3; ++indexIdx)
+			{
+				adjacency[adjacencyFill[indices[indexIdx]]++] = uint32_t(indexIdx / 3);
+			}
+
+			std::vector<int64_t> cacheTime(numVertices);
+			std::vector<bool> isEmitted(numTriangles);
+			std::vector<uint32_t> deadEnds{};
+			std::vector<uint32_t> candidates{};
+			std::vector<uint32_t> reordered{};
+			reordered.reserve(numTriangles * 3);
+
+			int64_t timeStamp{ cacheSize + 1 };
+			size_t cursor{ 1 };
+			int64_t fanVertex{ 0 };
+			while (fanVertex >= 0)
+			{
+				//emit everything around the fan vertex that is left
+				candidates.clear();
+				for (size_t adjacencyIdx{ adjacencyOffsets[fanVertex] }; adjacencyIdx < adjacencyOffsets[fanVertex + 1]; ++adjacencyIdx)
+				{
+					const uint32_t triangleIdx{ adjacency[adjacencyIdx] };
+					if (isEmitted[triangleIdx])
+						continue;
+
+					for (int corner{}; corner < 3; ++corner)
+					{
+						const uint32_t vertexIdx{ indices[triangleIdx * 3 + corner] };
+						reordered.push_back(vertexIdx);
+						deadEnds.push_back(vertexIdx);
+						candidates.push_back(vertexIdx);
+						--liveTriangles[vertexIdx];
+						if (timeStamp - cacheTime[vertexIdx] > cacheSize)
+						{
+							cacheTime[vertexIdx] = timeStamp++;
+						}
+					}
+					isEmitted[triangleIdx] = true;
+				}
+
+				//next fan: the candidate that stays in the cache while we go around it, oldest first
+				fanVertex = -1;
+				int64_t bestPriority{ -1 };
+				for (uint32_t vertexIdx : candidates)
+				{
+					if (liveTriangles[vertexIdx] == 0)
+						continue;
+
+					int64_t priority{};
+					if (timeStamp - cacheTime[vertexIdx] + 2 * int64_t(liveTriangles[vertexIdx]) <= cacheSize)
+					{
+						priority = timeStamp - cacheTime[vertexIdx];
+					}
+					if (priority > bestPriority)
+					{
+						bestPriority = priority;
+						fanVertex = vertexIdx;
+					}
+				}
+
+				//dead end, go back to something we touched recently or else just the next vertex that has triangles left
+				while (fanVertex < 0 && !deadEnds.empty())
+				{
+					const uint32_t vertexIdx{ deadEnds.back() };
+					deadEnds.pop_back();
+					if (liveTriangles[vertexIdx] > 0)
+					{
+						fanVertex = vertexIdx;
+					}
+				}
+				for (; fanVertex < 0 && cursor < numVertices; ++cursor)
+				{
+					if (liveTriangles[cursor] > 0)
+					{
+						fanVertex = cursor;
+					}
+				}
+			}
+
+			indices.swap(reordered);
+		}
+
+		//Splits a triangle list in meshlets of at most maxVertices/maxTriangles.
+		//A meshlet grows from a seed triangle to the neighbours that add the fewest vertices, and of those to the closest one facing the same way,
+		//so the normal cones stay narrow enough to cull something. Filling in index order mixes every direction in one meshlet.
+		//Vertices shared by two meshlets get duplicated, that way every meshlet owns one range of vertices the vertex stage can skip.
+		static void BuildMeshlets(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices, std::vector<Meshlet>& meshlets, size_t maxVertices = 64, size_t maxTriangles = 64)
+		{
+			meshlets.clear();
+			const size_t numTriangles{ indices.size() / 3 };
+			if (numTriangles == 0)
+				return;
+
+			auto faceNormal = [](const std::vector<Vertex>& faceVertices, uint32_t index0, uint32_t index1, uint32_t index2)
+				{
+					const Vector3& p0{ faceVertices[index0].position };
+					return Vector3::Cross(faceVertices[index1].position - p0, faceVertices[index2].position - p0);
+				};
+
+			//which way the winding points compared to the vertex normals, so the cones point outwards
+			float windingSign{};
+			for (size_t triangleIdx{}; triangleIdx < numTriangles; ++triangleIdx)
+			{
+				const uint32_t index0{ indices[triangleIdx * 3] }, index1{ indices[triangleIdx * 3 + 1] }, index2{ indices[triangleIdx * 3 + 2] };
+				windingSign += Vector3::Dot(faceNormal(vertices, index0, index1, index2), vertices[index0].normal + vertices[index1].normal + vertices[index2].normal);
+			}
+			windingSign = windingSign >= 0.f ? 1.f : -1.f;
+
+			//per triangle: the outwards unit normal and the center, what a growing meshlet compares against
+			std::vector<Vector3> triangleNormals(numTriangles);
+			std::vector<Vector3> triangleCenters(numTriangles);
+			float totalArea{};
+			for (size_t triangleIdx{}; triangleIdx < numTriangles; ++triangleIdx)
+			{
+				const uint32_t index0{ indices[triangleIdx * 3] }, index1{ indices[triangleIdx * 3 + 1] }, index2{ indices[triangleIdx * 3 + 2] };
+				const Vector3 normal{ faceNormal(vertices, index0, index1, index2) };
+				const float doubleArea{ normal.Magnitude() };
+				totalArea += doubleArea * 0.5f;
+				triangleNormals[triangleIdx] = doubleArea > 0.f ? normal * (windingSign / doubleArea) : Vector3{};
+				triangleCenters[triangleIdx] = (vertices[index0].position + vertices[index1].position + vertices[index2].position) / 3.f;
+			}
+
+			//radius of a full meshlet of average triangles, distances are measured in that so they weigh the same on any mesh
+			const float expectedRadius{ std::sqrt(totalArea / numTriangles * maxTriangles) * 0.5f };
+			const float invExpectedRadius{ expectedRadius > 0.f ? 1.f / expectedRadius : 0.f };
+			//how much facing the same way counts against being close, 0 only looks at the distance
+			constexpr float coneWeight{ 0.75f };
+
+			//triangles using each vertex, the ones of vertex v are vertexTriangles[vertexFirstTriangle[v]] up to vertexFirstTriangle[v + 1]
+			std::vector<uint32_t> vertexFirstTriangle(vertices.size() + 1, 0);
+			for (uint32_t index : indices)
+			{
+				++vertexFirstTriangle[index + 1];
+			}
+			for (size_t vertexIdx{}; vertexIdx < vertices.size(); ++vertexIdx)
+			{
+				vertexFirstTriangle[vertexIdx + 1] += vertexFirstTriangle[vertexIdx];
+			}
+			std::vector<uint32_t> vertexTriangles(indices.size());
+			{
+				std::vector<uint32_t> fillPosition(vertexFirstTriangle.begin(), vertexFirstTriangle.end() - 1);
+				for (size_t indexIdx{}; indexIdx < indices.size(); ++indexIdx)
+				{
+					vertexTriangles[fillPosition[indices[indexIdx]]++] = uint32_t(indexIdx / 3);
+				}
+			}
+			std::vector<bool> isTriangleUsed(numTriangles, false);
+
+			//triangles that are left, linked in index order so taking one out is cheap and the first ones are always at hand
+			std::vector<uint32_t> nextUnused(numTriangles), previousUnused(numTriangles);
+			for (uint32_t triangleIdx{}; triangleIdx < numTriangles; ++triangleIdx)
+			{
+				nextUnused[triangleIdx] = triangleIdx + 1;
+				previousUnused[triangleIdx] = triangleIdx - 1;
+			}
+			const uint32_t noTriangle{ uint32_t(numTriangles) };
+			uint32_t firstUnused{};
+
+			//grid over the triangle centers with cells about a meshlet big, for when a meshlet runs out of neighbours.
+			//A uv seam or a loose part cuts the adjacency, the triangles right across it are then only a cell or two away.
+			Vector3 centersMin{ triangleCenters[0] };
+			Vector3 centersMax{ centersMin };
+			for (const Vector3& center : triangleCenters)
+			{
+				centersMin = Vector3{ std::min(centersMin.x, center.x), std::min(centersMin.y, center.y), std::min(centersMin.z, center.z) };
+				centersMax = Vector3{ std::max(centersMax.x, center.x), std::max(centersMax.y, center.y), std::max(centersMax.z, center.z) };
+			}
+			//no more cells than triangles, a few far away ones would make the grid huge otherwise
+			const int maxCellsPerAxis{ std::max(1, int(std::cbrt(float(numTriangles)))) };
+			int numCells[3]{};
+			float cellsPerUnit[3]{};
+			for (int axis{}; axis < 3; ++axis)
+			{
+				const float extent{ centersMax[axis] - centersMin[axis] };
+				numCells[axis] = std::clamp(int(extent * invExpectedRadius) + 1, 1, maxCellsPerAxis);
+				cellsPerUnit[axis] = extent > 0.f ? numCells[axis] / extent : 0.f;
+			}
+			auto getCell = [&](const Vector3& position, int axis)
+				{
+					return std::clamp(int((position[axis] - centersMin[axis]) * cellsPerUnit[axis]), 0, numCells[axis] - 1);
+				};
+
+			//triangles of cell c are cellTriangles[cellFirst[c]] up to cellEnd[c], used ones get swapped out when a search comes by
+			std::vector<uint32_t> cellFirst(size_t(numCells[0]) * numCells[1] * numCells[2] + 1, 0);
+			std::vector<uint32_t> triangleCells(numTriangles);
+			for (uint32_t triangleIdx{}; triangleIdx < numTriangles; ++triangleIdx)
+			{
+				const Vector3& center{ triangleCenters[triangleIdx] };
+				triangleCells[triangleIdx] = uint32_t(getCell(center, 0) + numCells[0] * (getCell(center, 1) + numCells[1] * getCell(center, 2)));
+				++cellFirst[triangleCells[triangleIdx] + 1];
+			}
+			for (size_t cellIdx{}; cellIdx + 1 < cellFirst.size(); ++cellIdx)
+			{
+				cellFirst[cellIdx + 1] += cellFirst[cellIdx];
+			}
+			std::vector<uint32_t> cellEnd(cellFirst.begin(), cellFirst.end() - 1);
+			std::vector<uint32_t> cellTriangles(numTriangles);
+			for (uint32_t triangleIdx{}; triangleIdx < numTriangles; ++triangleIdx)
+			{
+				cellTriangles[cellEnd[triangleCells[triangleIdx]]++] = triangleIdx;
+			}
+			//a search stops at this many cells out and after this many triangles, so it costs the same on any mesh
+			constexpr int maxSearchRadius{ 4 };
+			const size_t maxSearchTriangles{ maxTriangles * 16 };
+
+			std::vector<Vertex> meshletVertices{};
+			std::vector<uint32_t> meshletIndices{};
+			meshletVertices.reserve(vertices.size());
+			meshletIndices.reserve(indices.size());
+
+			//old index -> index in meshletVertices, only for the meshlet that is being filled
+			std::vector<uint32_t> remap(vertices.size(), UINT32_MAX);
+			std::vector<uint32_t> remapped{};
+
+			Meshlet meshlet{};
+			std::vector<uint32_t> localIndices{};
+			Vector3 meshletNormalSum{};
+			Vector3 meshletCenterSum{};
+			auto finishMeshlet = [&]()
+				{
+					if (meshlet.triangleCount == 0)
+						return;
+					meshlet.vertexCount = uint32_t(meshletVertices.size()) - meshlet.firstVertex;
+
+					//the growth order jumps around, so put the triangles back in cache order (on local indices, the meshlet is all Tipsify sees)
+					const auto firstIndex{ meshletIndices.begin() + size_t(meshlet.firstTriangle) * 3 };
+					localIndices.assign(firstIndex, meshletIndices.end());
+					for (uint32_t& index : localIndices)
+					{
+						index -= meshlet.firstVertex;
+					}
+					OptimizeVertexCache(localIndices, meshlet.vertexCount);
+					std::transform(localIndices.begin(), localIndices.end(), firstIndex, [&](uint32_t index) { return index + meshlet.firstVertex; });
+
+					//sphere around the box center, as big as the farthest vertex
+					Vector3 boundsMin{ meshletVertices[meshlet.firstVertex].position };
+					Vector3 boundsMax{ boundsMin };
+					for (uint32_t vertexIdx{ meshlet.firstVertex }; vertexIdx < meshlet.firstVertex + meshlet.vertexCount; ++vertexIdx)
+					{
+						const Vector3& position{ meshletVertices[vertexIdx].position };
+						boundsMin = Vector3{ std::min(boundsMin.x, position.x), std::min(boundsMin.y, position.y), std::min(boundsMin.z, position.z) };
+						boundsMax = Vector3{ std::max(boundsMax.x, position.x), std::max(boundsMax.y, position.y), std::max(boundsMax.z, position.z) };
+					}
+					meshlet.center = (boundsMin + boundsMax) * 0.5f;
+					float sqrRadius{};
+					for (uint32_t vertexIdx{ meshlet.firstVertex }; vertexIdx < meshlet.firstVertex + meshlet.vertexCount; ++vertexIdx)
+					{
+						sqrRadius = std::max(sqrRadius, (meshletVertices[vertexIdx].position - meshlet.center).SqrMagnitude());
+					}
+					meshlet.radius = std::sqrt(sqrRadius);
+
+					//normal cone: average face normal, and how far the faces stray from it
+					Vector3 axis{};
+					for (uint32_t triangleIdx{ meshlet.firstTriangle }; triangleIdx < meshlet.firstTriangle + meshlet.triangleCount; ++triangleIdx)
+					{
+						const Vector3 normal{ faceNormal(meshletVertices, meshletIndices[triangleIdx * 3], meshletIndices[triangleIdx * 3 + 1], meshletIndices[triangleIdx * 3 + 2]) };
+						if (normal.SqrMagnitude() > 0.f)
+							axis += normal.Normalized() * windingSign;
+					}
+					meshlet.coneAxis = Vector3{};
+					meshlet.coneCutoff = 1.f;
+					if (axis.SqrMagnitude() > 0.f)
+					{
+						axis.Normalize();
+						float minDot{ 1.f };
+						for (uint32_t triangleIdx{ meshlet.firstTriangle }; triangleIdx < meshlet.firstTriangle + meshlet.triangleCount; ++triangleIdx)
+						{
+							const Vector3 normal{ faceNormal(meshletVertices, meshletIndices[triangleIdx * 3], meshletIndices[triangleIdx * 3 + 1], meshletIndices[triangleIdx * 3 + 2]) };
+							if (normal.SqrMagnitude() > 0.f)
+								minDot = std::min(minDot, Vector3::Dot(axis, normal.Normalized() * windingSign));
+						}
+						//wider than about 84 degrees and the test would hardly ever cull anything
+						if (minDot > 0.1f)
+						{
+							meshlet.coneAxis = axis;
+							meshlet.coneCutoff = std::sqrt(1.f - minDot * minDot);
+						}
+					}
+
+					meshlets.push_back(meshlet);
+					for (uint32_t index : remapped)
+					{
+						remap[index] = UINT32_MAX;
+					}
+					remapped.clear();
+					meshlet = Meshlet{};
+					meshletNormalSum = Vector3{};
+					meshletCenterSum = Vector3{};
+					meshlet.firstVertex = uint32_t(meshletVertices.size());
+					meshlet.firstTriangle = uint32_t(meshletIndices.size() / 3);
+				};
+
+			auto countNewVertices = [&](size_t triangleIdx)
+				{
+					const uint32_t index0{ indices[triangleIdx * 3] }, index1{ indices[triangleIdx * 3 + 1] }, index2{ indices[triangleIdx * 3 + 2] };
+					return size_t(remap[index0] == UINT32_MAX)
+						+ size_t(remap[index1] == UINT32_MAX && index1 != index0)
+						+ size_t(remap[index2] == UINT32_MAX && index2 != index0 && index2 != index1);
+				};
+
+			for (size_t numAdded{}; numAdded < numTriangles; ++numAdded)
+			{
+				size_t bestTriangle{ SIZE_MAX };
+				if (meshlet.triangleCount > 0 && meshlet.triangleCount < maxTriangles)
+				{
+					const Vector3 axis{ meshletNormalSum.SqrMagnitude() > 0.f ? meshletNormalSum.Normalized() : Vector3{} };
+					const Vector3 center{ meshletCenterSum / float(meshlet.triangleCount) };
+					const size_t numVertices{ meshletVertices.size() - meshlet.firstVertex };
+
+					//fewest new vertices first, then lowest score: close to the meshlet and facing the way it does
+					size_t bestNewVertices{ SIZE_MAX };
+					float bestScore{ FLT_MAX };
+					auto considerTriangle = [&](uint32_t triangleIdx)
+						{
+							if (isTriangleUsed[triangleIdx])
+								return;
+							const size_t numNewVertices{ countNewVertices(triangleIdx) };
+							if (numVertices + numNewVertices > maxVertices || numNewVertices > bestNewVertices)
+								return;
+
+							const float spread{ Vector3::Dot(triangleNormals[triangleIdx], axis) };
+							const float cone{ std::max(1.f - spread * coneWeight, 1e-3f) };
+							const float distance{ (triangleCenters[triangleIdx] - center).Magnitude() * invExpectedRadius };
+							const float score{ (1.f + distance * (1.f - coneWeight)) * cone };
+							if (numNewVertices < bestNewVertices || score < bestScore)
+							{
+								bestTriangle = triangleIdx;
+								bestNewVertices = numNewVertices;
+								bestScore = score;
+							}
+						};
+
+					//only the neighbours, they share at least one vertex
+					for (uint32_t index : remapped)
+					{
+						for (uint32_t adjacentIdx{ vertexFirstTriangle[index] }; adjacentIdx < vertexFirstTriangle[index + 1]; ++adjacentIdx)
+						{
+							considerTriangle(vertexTriangles[adjacentIdx]);
+						}
+					}
+
+					//that part of the mesh is done but there is still room, so take what fits best from the cells around it, closest rings first.
+					//Not only the closest ring with something in it, a triangle a bit further that faces the same way makes a tighter cone
+					if (bestTriangle == SIZE_MAX)
+					{
+						const int centerCell[3]{ getCell(center, 0), getCell(center, 1), getCell(center, 2) };
+						size_t numSearched{};
+						for (int radius{}; radius <= maxSearchRadius && numSearched < maxSearchTriangles; ++radius)
+						{
+							for (int cellZ{ std::max(centerCell[2] - radius, 0) }; cellZ <= std::min(centerCell[2] + radius, numCells[2] - 1); ++cellZ)
+							{
+								for (int cellY{ std::max(centerCell[1] - radius, 0) }; cellY <= std::min(centerCell[1] + radius, numCells[1] - 1); ++cellY)
+								{
+									for (int cellX{ std::max(centerCell[0] - radius, 0) }; cellX <= std::min(centerCell[0] + radius, numCells[0] - 1); ++cellX)
+									{
+										//only the shell, the inside was done by the smaller radius
+										if (std::max({ std::abs(cellX - centerCell[0]), std::abs(cellY - centerCell[1]), std::abs(cellZ - centerCell[2]) }) != radius)
+											continue;
+										const size_t cellIdx{ size_t(cellX) + numCells[0] * (size_t(cellY) + size_t(numCells[1]) * cellZ) };
+										for (uint32_t position{ cellFirst[cellIdx] }; position < cellEnd[cellIdx] && numSearched < maxSearchTriangles;)
+										{
+											const uint32_t triangleIdx{ cellTriangles[position] };
+											if (isTriangleUsed[triangleIdx])
+											{
+												cellTriangles[position] = cellTriangles[--cellEnd[cellIdx]];
+												continue;
+											}
+											considerTriangle(triangleIdx);
+											++position;
+											++numSearched;
+										}
+									}
+								}
+							}
+						}
+					}
+				}
+
+				//full, or nothing fits anymore: the next one starts at the first triangle that is left
+				if (bestTriangle == SIZE_MAX)
+				{
+					finishMeshlet();
+					bestTriangle = firstUnused;
+				}
+
+				for (size_t cornerIdx{}; cornerIdx < 3; ++cornerIdx)
+				{
+					const uint32_t index{ indices[bestTriangle * 3 + cornerIdx] };
+					if (remap[index] == UINT32_MAX)
+					{
+						remap[index] = uint32_t(meshletVertices.size());
+						remapped.push_back(index);
+						meshletVertices.push_back(vertices[index]);
+					}
+					meshletIndices.push_back(remap[index]);
+				}
+				isTriangleUsed[bestTriangle] = true;
+				if (bestTriangle == firstUnused)
+					firstUnused = nextUnused[bestTriangle];
+				else
+					nextUnused[previousUnused[bestTriangle]] = nextUnused[bestTriangle];
+				if (nextUnused[bestTriangle] != noTriangle)
+					previousUnused[nextUnused[bestTriangle]] = previousUnused[bestTriangle];
+				meshletNormalSum += triangleNormals[bestTriangle];
+				meshletCenterSum += triangleCenters[bestTriangle];
+				++meshlet.triangleCount;
+			}
+			finishMeshlet();
+
+#ifdef PRINT_STATS
+			//a far away camera in a random direction is inside the culling part of a cone (1 - cutoff) / 2 of the time
+			size_t numCones{};
+			float coneCulledTriangles{};
+			for (const Meshlet& finished : meshlets)
+			{
+				if (finished.coneCutoff < 1.f)
+				{
+					++numCones;
+					coneCulledTriangles += (1.f - finished.coneCutoff) * 0.5f * finished.triangleCount;
+				}
+			}
+
+			std::cout << "BuildMeshlets: " << meshlets.size() << " meshlets (" << float(numTriangles) / meshlets.size() << " triangles each), "
+				<< vertices.size() << " -> " << meshletVertices.size() << " vertices, " << numCones << " with a normal cone (culls "
+				<< 100.f * coneCulledTriangles / numTriangles << "% of the triangles from a random direction), vertex cache ACMR "
+				<< CalculateACMR(meshletIndices, meshletVertices.size()) << std::endl;
+#endif
+
+			vertices.swap(meshletVertices);
+			indices.swap(meshletIndices);
+		}
+
+		//plane quadric of the simplifier: sum of weight * dot(plane, (p, 1))^2 over every plane that was added
+		struct Quadric
+		{
+			double aa, ab, ac, ad, bb, bc, bd, cc, cd, dd;
+			double weight;
+
+			void AddPlane(double a, double b, double c, double d, double planeWeight)
+			{
+				aa += planeWeight * a * a; ab += planeWeight * a * b; ac += planeWeight * a * c; ad += planeWeight * a * d;
+				bb += planeWeight * b * b; bc += planeWeight * b * c; bd += planeWeight * b * d;
+				cc += planeWeight * c * c; cd += planeWeight * c * d;
+				dd += planeWeight * d * d;
+				weight += planeWeight;
+			}
+
+			Quadric& operator+=(const Quadric& other)
+			{
+				aa += other.aa; ab += other.ab; ac += other.ac; ad += other.ad;
+				bb += other.bb; bc += other.bc; bd += other.bd;
+				cc += other.cc; cd += other.cd;
+				dd += other.dd;
+				weight += other.weight;
+				return *this;
+			}
+
+			double Evaluate(const Vector3& p) const
+			{
+				const double x{ p.x }, y{ p.y }, z{ p.z };
+				return aa * x * x + 2 * ab * x * y + 2 * ac * x * z + 2 * ad * x
+					+ bb * y * y + 2 * bc * y * z + 2 * bd * y
+					+ cc * z * z + 2 * cd * z
+					+ dd;
+			}
+		};
+
+		//Quadric error metric simplification (Garland, Heckbert 1997) into a chain of lods with half the triangles each, until minTriangles.
+		//Half edge collapses only, so every lod uses a subset of the original vertices and keeps their uv/normal/tangent.
+		//Positions with several vertices (uv/normal seams) collapse as a whole, only when every copy has its own copy on the other side to go to,
+		//that way seams never tear open. Open borders get extra planes so they keep their shape.
+		static void BuildLodChain(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices, std::vector<Mesh>& lods, size_t minTriangles = 64)
+		{
+			lods.clear();
+			const size_t numTriangles{ indices.size() / 3 };
+			if (numTriangles / 2 < minTriangles)
+				return;
+
+			//vertices with the same position are one point for the simplifier
+			struct PositionKey
+			{
+				float x, y, z;
+				bool operator<(const PositionKey& other) const { return std::tie(x, y, z) < std::tie(other.x, other.y, other.z); }
+			};
+			std::map<PositionKey, uint32_t> positionIds{};
+			std::vector<uint32_t> positionOf(vertices.size());
+			std::vector<Vector3> positions{};
+			for (size_t vertexIdx{}; vertexIdx < vertices.size(); ++vertexIdx)
+			{
+				const Vector3& position{ vertices[vertexIdx].position };
+				const auto [it, isNew] { positionIds.emplace(PositionKey{ position.x, position.y, position.z }, uint32_t(positions.size())) };
+				if (isNew)
+					positions.push_back(position);
+				positionOf[vertexIdx] = it->second;
+			}
+			const size_t numPositions{ positions.size() };
+
+			std::vector<uint32_t> triangles(indices.begin(), indices.begin() + numTriangles * 3);
+			std::vector<bool> isTriangleAlive(numTriangles, true);
+			std::vector<std::vector<uint32_t>> positionTriangles(numPositions);
+			std::vector<Quadric> quadrics(numPositions, Quadric{});
+			size_t numAliveTriangles{ numTriangles };
+
+			auto trianglePosition = [&](size_t triangleIdx, int corner) -> const Vector3& { return positions[positionOf[triangles[triangleIdx * 3 + corner]]]; };
+
+			//face planes, weighted by area so tiny triangles do not get a say as big as big ones
+			std::map<std::pair<uint32_t, uint32_t>, std::pair<int, size_t>> edgeUse{};
+			for (size_t triangleIdx{}; triangleIdx < numTriangles; ++triangleIdx)
+			{
+				const Vector3& p0{ trianglePosition(triangleIdx, 0) };
+				const Vector3 cross{ Vector3::Cross(trianglePosition(triangleIdx, 1) - p0, trianglePosition(triangleIdx, 2) - p0) };
+				const float doubleArea{ cross.Magnitude() };
+				for (int corner{}; corner < 3; ++corner)
+				{
+					const uint32_t position{ positionOf[triangles[triangleIdx * 3 + corner]] };
+					positionTriangles[position].push_back(uint32_t(triangleIdx));
+
+					const uint32_t nextPosition{ positionOf[triangles[triangleIdx * 3 + (corner + 1) % 3]] };
+					auto& [count, lastTriangle] { edgeUse[std::minmax(position, nextPosition)] };
+					++count;
+					lastTriangle = triangleIdx;
+				}
+				if (doubleArea <= 0.f)
+					continue;
+
+				const Vector3 normal{ cross / doubleArea };
+				for (int corner{}; corner < 3; ++corner)
+				{
+					quadrics[positionOf[triangles[triangleIdx * 3 + corner]]].AddPlane(normal.x, normal.y, normal.z, -Vector3::Dot(normal, p0), doubleArea * 0.5);
+				}
+			}
+
+			//border edges get a plane through the edge, standing on the face, with a big weight
+			const double borderWeight{ 10.0 };
+			for (const auto& [edge, use] : edgeUse)
+			{
+				if (use.first != 1 || edge.first == edge.second)
+					continue;
+
+				const Vector3& p0{ trianglePosition(use.second, 0) };
+				const Vector3 faceNormal{ Vector3::Cross(trianglePosition(use.second, 1) - p0, trianglePosition(use.second, 2) - p0) };
+				const Vector3 edgeVector{ positions[edge.second] - positions[edge.first] };
+				Vector3 normal{ Vector3::Cross(edgeVector, faceNormal) };
+				if (normal.SqrMagnitude() <= 0.f)
+					continue;
+				normal.Normalize();
+
+				const double planeWeight{ borderWeight * edgeVector.SqrMagnitude() };
+				const double d{ -Vector3::Dot(normal, positions[edge.first]) };
+				quadrics[edge.first].AddPlane(normal.x, normal.y, normal.z, d, planeWeight);
+				quadrics[edge.second].AddPlane(normal.x, normal.y, normal.z, d, planeWeight);
+			}
+
+			//live triangles around a position, positionTriangles also still has dead ones and doubles
+			std::vector<uint32_t> triangleStamp(numTriangles, UINT32_MAX);
+			uint32_t stamp{};
+			auto gatherTriangles = [&](uint32_t position, std::vector<uint32_t>& result)
+				{
+					result.clear();
+					++stamp;
+					for (uint32_t triangleIdx : positionTriangles[position])
+					{
+						if (!isTriangleAlive[triangleIdx] || triangleStamp[triangleIdx] == stamp)
+							continue;
+						triangleStamp[triangleIdx] = stamp;
+						result.push_back(triangleIdx);
+					}
+				};
+
+			//candidates are lazily thrown out: a collapse bumps the version of the position it collapsed to
+			struct Collapse
+			{
+				double cost;
+				uint32_t from;
+				uint32_t to;
+				uint32_t fromVersion;
+				uint32_t toVersion;
+				bool operator>(const Collapse& other) const { return cost > other.cost; }
+			};
+			std::priority_queue<Collapse, std::vector<Collapse>, std::greater<Collapse>> candidates{};
+			std::vector<uint32_t> versions(numPositions);
+			std::vector<bool> isPositionAlive(numPositions, true);
+
+			auto collapseCost = [&](uint32_t from, uint32_t to)
+				{
+					Quadric quadric{ quadrics[from] };
+					quadric += quadrics[to];
+					return std::max(0.0, quadric.Evaluate(positions[to]));
+				};
+
+			std::vector<uint32_t> around{};
+			auto pushCandidates = [&](uint32_t position)
+				{
+					gatherTriangles(position, around);
+					for (uint32_t triangleIdx : around)
+					{
+						for (int corner{}; corner < 3; ++corner)
+						{
+							const uint32_t neighbour{ positionOf[triangles[triangleIdx * 3 + corner]] };
+							if (neighbour == position)
+								continue;
+							candidates.push(Collapse{ collapseCost(position, neighbour), position, neighbour, versions[position], versions[neighbour] });
+							candidates.push(Collapse{ collapseCost(neighbour, position), neighbour, position, versions[neighbour], versions[position] });
+						}
+					}
+				};
+			for (uint32_t position{}; position < numPositions; ++position)
+			{
+				pushCandidates(position);
+			}
+
+			std::vector<uint32_t> fromTriangles{};
+			std::vector<std::pair<uint32_t, uint32_t>> copyTargets{}; //vertex at from -> vertex at to
+			auto tryCollapse = [&](uint32_t from, uint32_t to)
+				{
+					gatherTriangles(from, fromTriangles);
+
+					//every copy of from needs exactly one copy of to next to it
+					copyTargets.clear();
+					for (uint32_t triangleIdx : fromTriangles)
+					{
+						uint32_t fromVertex{ UINT32_MAX }, toVertex{ UINT32_MAX };
+						for (int corner{}; corner < 3; ++corner)
+						{
+							const uint32_t vertex{ triangles[triangleIdx * 3 + corner] };
+							if (positionOf[vertex] == from) fromVertex = vertex;
+							if (positionOf[vertex] == to) toVertex = vertex;
+						}
+						auto it{ std::find_if(copyTargets.begin(), copyTargets.end(), [&](const auto& target) { return target.first == fromVertex; }) };
+						if (it == copyTargets.end())
+							copyTargets.emplace_back(fromVertex, toVertex);
+						else if (it->second == UINT32_MAX)
+							it->second = toVertex;
+						else if (toVertex != UINT32_MAX && it->second != toVertex)
+							return false;
+					}
+					for (const auto& target : copyTargets)
+					{
+						if (target.second == UINT32_MAX)
+							return false;
+					}
+
+					//no triangle is allowed to flip over
+					for (uint32_t triangleIdx : fromTriangles)
+					{
+						Vector3 oldCorners[3], newCorners[3];
+						bool hasTo{ false };
+						for (int corner{}; corner < 3; ++corner)
+						{
+							const uint32_t position{ positionOf[triangles[triangleIdx * 3 + corner]] };
+							hasTo |= position == to;
+							oldCorners[corner] = positions[position];
+							newCorners[corner] = position == from ? positions[to] : positions[position];
+						}
+						if (hasTo)
+							continue;
+
+						const Vector3 oldNormal{ Vector3::Cross(oldCorners[1] - oldCorners[0], oldCorners[2] - oldCorners[0]) };
+						const Vector3 newNormal{ Vector3::Cross(newCorners[1] - newCorners[0], newCorners[2] - newCorners[0]) };
+						if (Vector3::Dot(oldNormal, newNormal) <= 0.f)
+							return false;
+					}
+
+					for (uint32_t triangleIdx : fromTriangles)
+					{
+						bool hasTo{ false };
+						for (int corner{}; corner < 3; ++corner)
+						{
+							hasTo |= positionOf[triangles[triangleIdx * 3 + corner]] == to;
+						}
+						if (hasTo)
+						{
+							isTriangleAlive[triangleIdx] = false;
+							--numAliveTriangles;
+							continue;
+						}
+
+						for (int corner{}; corner < 3; ++corner)
+						{
+							uint32_t& vertex{ triangles[triangleIdx * 3 + corner] };
+							if (positionOf[vertex] == from)
+								vertex = std::find_if(copyTargets.begin(), copyTargets.end(), [&](const auto& target) { return target.first == vertex; })->second;
+						}
+						positionTriangles[to].push_back(triangleIdx);
+					}
+
+					quadrics[to] += quadrics[from];
+					isPositionAlive[from] = false;
+					++versions[to];
+					pushCandidates(to);
+					return true;
+				};
+
+			//the live triangles as a mesh of their own, only with the vertices they use
+			auto addLod = [&](float error)
+				{
+					Mesh& lod{ lods.emplace_back() };
+					lod.primitiveTopology = PrimitiveTopology::TriangleList;
+					lod.lodError = error;
+
+					std::vector<uint32_t> remap(vertices.size(), UINT32_MAX);
+					for (size_t triangleIdx{}; triangleIdx < numTriangles; ++triangleIdx)
+					{
+						if (!isTriangleAlive[triangleIdx])
+							continue;
+						for (int corner{}; corner < 3; ++corner)
+						{
+							const uint32_t vertex{ triangles[triangleIdx * 3 + corner] };
+							if (remap[vertex] == UINT32_MAX)
+							{
+								remap[vertex] = uint32_t(lod.vertices.size());
+								lod.vertices.push_back(vertices[vertex]);
+							}
+							lod.indices.push_back(remap[vertex]);
+						}
+					}
+					OptimizeVertexCache(lod.indices, lod.vertices.size());
+				};
+
+			size_t targetTriangles{ numTriangles / 2 };
+			size_t lastLodTriangles{ numTriangles };
+			double maxError{};
+			while (!candidates.empty() && targetTriangles >= minTriangles)
+			{
+				const Collapse collapse{ candidates.top() };
+				candidates.pop();
+				if (!isPositionAlive[collapse.from] || !isPositionAlive[collapse.to]
+					|| versions[collapse.from] != collapse.fromVersion || versions[collapse.to] != collapse.toVersion)
+					continue;
+
+				const double weight{ quadrics[collapse.from].weight + quadrics[collapse.to].weight };
+				if (!tryCollapse(collapse.from, collapse.to))
+					continue;
+
+				//error as a distance: root mean square over the planes that went into the quadric
+				maxError = std::max(maxError, std::sqrt(collapse.cost / std::max(weight, 1e-12)));
+				if (numAliveTriangles <= targetTriangles)
+				{
+					addLod(float(maxError));
+					lastLodTriangles = numAliveTriangles;
+					targetTriangles = numAliveTriangles / 2;
+				}
+			}
+
+			//ran out of collapses, still keep what we have when it is a real step down
+			if (numAliveTriangles * 4 < lastLodTriangles * 3 && numAliveTriangles > 0)
+			{
+				addLod(float(maxError));
+			}
+
+#ifdef PRINT_STATS
+			std::cout << "BuildLodChain: " << numTriangles << " triangles";
+			for (const Mesh& lod : lods)
+			{
+				std::cout << " -> " << lod.indices.size() / 3 << " (error " << lod.lodError << ")";
+			}
+			std::cout << std::endl;
+#endif
+		}
+
+		//Just parses vertices and indices
 		static bool ParseOBJ(const std::string& filename, std::vector<Vertex>& vertices, std::vector<uint32_t>& indices, bool flipAxisAndWinding = true)
 		{
 #ifdef DISABLE_OBJ
@@ -34,12 +869,15 @@ namespace dae
 			vertices.clear();
 			indices.clear();
 
+			//welds the corners that share position/uv/normal, so the vertex stage only transforms them once
+			std::unordered_map<OBJVertexKey, uint32_t, OBJVertexKeyHash> vertexLookup{};
+			size_t numFaceCorners{};
+
 			std::string sCommand;
-			// start a while iteration ending when the end of file is reached (ios::eof)
-			while (!file.eof())
+			//read the first word of every line, use the >> operator (istream::operator>>)
+			//checking eof() before reading ran the last command again on a file that ends right after it
+			while (file >> sCommand)
 			{
-				//read the first word of the string, use the >> operator (istream::operator>>) 
-				file >> sCommand;
 				//use conditional statements to process the different commands	
 				if (sCommand == "#")
 				{
@@ -82,6 +920,9 @@ namespace dae
 					uint32_t tempIndices[3];
 					for (size_t iFace = 0; iFace < 3; iFace++)
 					{
+						iTexCoord = 0;
+						iNormal = 0;
+
 						// OBJ format uses 1-based arrays
 						file >> iPosition;
 						vertex.position = positions[iPosition - 1];
@@ -107,8 +948,13 @@ namespace dae
 							}
 						}
 
-						vertices.push_back(vertex);
-						tempIndices[iFace] = uint32_t(vertices.size()) - 1;
+						++numFaceCorners;
+						const auto [it, isNewVertex] { vertexLookup.try_emplace(OBJVertexKey{ iPosition, iTexCoord, iNormal }, uint32_t(vertices.size())) };
+						if (isNewVertex)
+						{
+							vertices.push_back(vertex);
+						}
+						tempIndices[iFace] = it->second;
 						//indices.push_back(uint32_t(vertices.size()) - 1);
 					}
 
@@ -128,6 +974,22 @@ namespace dae
 				file.ignore(1000, '\n');
 			}
 
+			if (!vertices.empty())
+			{
+#ifdef PRINT_STATS
+				std::cout << "ParseOBJ: " << filename << " welded " << numFaceCorners << " face corners into " << vertices.size()
+					<< " vertices (" << float(numFaceCorners) / vertices.size() << "x fewer)" << std::endl;
+				const float acmrBefore{ CalculateACMR(indices, vertices.size()) };
+#endif
+
+				//same triangles, but in an order that reuses recently transformed vertices
+				OptimizeVertexCache(indices, vertices.size());
+#ifdef PRINT_STATS
+				//BuildMeshlets reorders them again, it prints what is left of this
+				std::cout << "ParseOBJ: " << filename << " vertex cache ACMR " << acmrBefore << " -> " << CalculateACMR(indices, vertices.size()) << std::endl;
+#endif
+			}
+
 			//Cheap Tangent Calculations
 			for (uint32_t i = 0; i < indices.size(); i += 3)
 			{
@@ -146,7 +1008,15 @@ namespace dae
 				const Vector3 edge1 = p2 - p0;
 				const Vector2 diffX = Vector2(uv1.x - uv0.x, uv2.x - uv0.x);
 				const Vector2 diffY = Vector2(uv1.y - uv0.y, uv2.y - uv0.y);
-				float r = 1.f / Vector2::Cross(diffX, diffY);
+				const float uvArea = Vector2::Cross(diffX, diffY);
+
+				//no uv area (stretched or collapsed uvs) has no tangent direction, dividing by it gives inf/NaN
+				//compared to the uv edge lengths so tiny but fine triangles still count
+				const float uvEdgeLengths = (uv1 - uv0).Magnitude() * (uv2 - uv0).Magnitude();
+				if (std::abs(uvArea) <= 1e-6f * uvEdgeLengths)
+					continue;
+
+				float r = 1.f / uvArea;
 
 				Vector3 tangent = (edge0 * diffY.y - edge1 * diffY.x) * r;
 				vertices[index0].tangent += tangent;
@@ -157,7 +1027,18 @@ namespace dae
 			//Fix the tangents per vertex now because we accumulated
 			for (auto& v : vertices)
 			{
-				v.tangent = Vector3::Reject(v.tangent, v.normal).Normalized();
+				const Vector3 tangent = Vector3::Reject(v.tangent, v.normal);
+				if (tangent.SqrMagnitude() > 1e-12f)
+				{
+					v.tangent = tangent.Normalized();
+				}
+				else
+				{
+					//none of its triangles had a usable uv direction, any tangent on the surface will do
+					//crossed with an axis that is far enough from the normal so it never ends up zero
+					const Vector3 axis = std::abs(v.normal.x) < 0.5f ? Vector3::UnitX : Vector3::UnitY;
+					v.tangent = Vector3::Cross(v.normal, axis).Normalized();
+				}
 
 				if(flipAxisAndWinding)
 				{
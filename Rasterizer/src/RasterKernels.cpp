@@ -0,0 +1,178 @@
+#include "RasterKernels.h"
+
+#include <cassert>
+#include <emmintrin.h>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+
+namespace dae
+{
+	namespace
+	{
+		//reference version, the simd kernels also use it for the pixels that do not fill a whole register
+		uint32_t RasterPixelsScalar(const RasterTriangle& triangle, const SpanEdges& edges, int y, int x, int first, int last, float* pDepthRow, SpanResult& result)
+		{
+			const float pointY{ y + 0.5f - triangle.originY };
+			const float rowStartInvW{ triangle.invW.b * pointY + triangle.invW.c };
+
+			int32_t signedArea12{ edges.start[0] + edges.step[0] * first };
+			int32_t signedArea20{ edges.start[1] + edges.step[1] * first };
+			int32_t signedArea01{ edges.start[2] + edges.step[2] * first };
+
+			uint32_t mask{};
+			for (int i{ first }; i < last; ++i, signedArea12 += edges.step[0], signedArea20 += edges.step[1], signedArea01 += edges.step[2])
+			{
+				//sign bit of any of them set means outside
+				const bool isInsideTriangle{ (signedArea12 | signedArea20 | signedArea01) >= 0 };
+				if (!isInsideTriangle)
+					continue;
+
+				//perspective correct depth, same operations in the same order as the simd kernels so every kernel writes the same bits
+				const float pointX{ float(x + i) + 0.5f - triangle.originX };
+				const float depth{ 1.f / (triangle.invW.a * pointX + rowStartInvW) };
+				if (!(depth <= pDepthRow[i]))
+					continue;
+
+				pDepthRow[i] = depth;
+				result.depth[i] = depth;
+				mask |= 1u << i;
+			}
+			return mask;
+		}
+
+		void Cpuid(int leaf, int subLeaf, int info[4])
+		{
+#if defined(_MSC_VER)
+			__cpuidex(info, leaf, subLeaf);
+#else
+			unsigned int a{}, b{}, c{}, d{};
+			__cpuid_count(leaf, subLeaf, a, b, c, d);
+			info[0] = int(a);
+			info[1] = int(b);
+			info[2] = int(c);
+			info[3] = int(d);
+#endif
+		}
+
+		uint64_t ReadXCR0()
+		{
+#if defined(_MSC_VER)
+			return _xgetbv(0);
+#else
+			uint32_t eax{}, edx{};
+			__asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+			return (uint64_t(edx) << 32) | eax;
+#endif
+		}
+	}
+
+	uint32_t RasterSpanScalar(const RasterTriangle& triangle, const SpanEdges& edges, int y, int x, int count, float* pDepthRow, SpanResult& result)
+	{
+		assert(count <= MaxSpanLength);
+		return RasterPixelsScalar(triangle, edges, y, x, 0, count, pDepthRow, result);
+	}
+
+	uint32_t RasterSpanSSE(const RasterTriangle& triangle, const SpanEdges& edges, int y, int x, int count, float* pDepthRow, SpanResult& result)
+	{
+		assert(count <= MaxSpanLength);
+
+		const __m128 one{ _mm_set1_ps(1.f) };
+		const __m128i minusOne{ _mm_set1_epi32(-1) };
+		const __m128 laneOffsets{ _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f) };
+		const __m128 originX{ _mm_set1_ps(triangle.originX) };
+
+		//sse2 has no 32 bit multiply, so build the first 4 lanes by hand and add 4 steps every register
+		__m128i signedArea12{ _mm_setr_epi32(edges.start[0], edges.start[0] + edges.step[0], edges.start[0] + edges.step[0] * 2, edges.start[0] + edges.step[0] * 3) };
+		__m128i signedArea20{ _mm_setr_epi32(edges.start[1], edges.start[1] + edges.step[1], edges.start[1] + edges.step[1] * 2, edges.start[1] + edges.step[1] * 3) };
+		__m128i signedArea01{ _mm_setr_epi32(edges.start[2], edges.start[2] + edges.step[2], edges.start[2] + edges.step[2] * 2, edges.start[2] + edges.step[2] * 3) };
+		const __m128i step12{ _mm_set1_epi32(edges.step[0] * 4) };
+		const __m128i step20{ _mm_set1_epi32(edges.step[1] * 4) };
+		const __m128i step01{ _mm_set1_epi32(edges.step[2] * 4) };
+
+		const float pointY{ y + 0.5f - triangle.originY };
+		const __m128 aInvW{ _mm_set1_ps(triangle.invW.a) };
+		const __m128 rowStartInvW{ _mm_set1_ps(triangle.invW.b * pointY + triangle.invW.c) };
+
+		uint32_t mask{};
+		int i{};
+		for (; i + 4 <= count; i += 4, signedArea12 = _mm_add_epi32(signedArea12, step12), signedArea20 = _mm_add_epi32(signedArea20, step20), signedArea01 = _mm_add_epi32(signedArea01, step01))
+		{
+			const __m128 inside{ _mm_castsi128_ps(_mm_cmpgt_epi32(_mm_or_si128(signedArea12, _mm_or_si128(signedArea20, signedArea01)), minusOne)) };
+			if (_mm_movemask_ps(inside) == 0)
+				continue;
+
+			const __m128 pointX{ _mm_sub_ps(_mm_add_ps(_mm_set1_ps(float(x + i)), laneOffsets), originX) };
+			const __m128 depth{ _mm_div_ps(one, _mm_add_ps(_mm_mul_ps(aInvW, pointX), rowStartInvW)) };
+
+			//whole register is inside the span, so writing the old value back for the failed lanes is fine
+			const __m128 oldDepth{ _mm_loadu_ps(pDepthRow + i) };
+			const __m128 pass{ _mm_and_ps(inside, _mm_cmple_ps(depth, oldDepth)) };
+			_mm_storeu_ps(pDepthRow + i, _mm_or_ps(_mm_and_ps(pass, depth), _mm_andnot_ps(pass, oldDepth)));
+
+			_mm_store_ps(result.depth + i, depth);
+			mask |= uint32_t(_mm_movemask_ps(pass)) << i;
+		}
+
+		return mask | RasterPixelsScalar(triangle, edges, y, x, i, count, pDepthRow, result);
+	}
+
+	RasterKernel GetBestRasterKernel()
+	{
+		int info[4]{};
+		Cpuid(0, 0, info);
+		const int maxLeaf{ info[0] };
+
+		Cpuid(1, 0, info);
+		const bool hasSSE2{ (info[3] & (1 << 26)) != 0 };
+		const bool hasFMA{ (info[2] & (1 << 12)) != 0 };
+		const bool hasF16C{ (info[2] & (1 << 29)) != 0 }; //the avx2 vertex kernel packs halves with it
+		const bool hasOSXSAVE{ (info[2] & (1 << 27)) != 0 };
+		const bool hasAVX{ (info[2] & (1 << 28)) != 0 };
+
+		//the os also has to save the ymm registers on a context switch
+		const bool osSavesYMM{ hasOSXSAVE && (ReadXCR0() & 0x6) == 0x6 };
+
+		bool hasAVX2{ false };
+		if (maxLeaf >= 7)
+		{
+			Cpuid(7, 0, info);
+			hasAVX2 = (info[1] & (1 << 5)) != 0;
+		}
+
+		if (hasAVX && hasAVX2 && hasFMA && hasF16C && osSavesYMM)
+			return RasterKernel::AVX2;
+		if (hasSSE2)
+			return RasterKernel::SSE;
+		return RasterKernel::Scalar;
+	}
+
+	RasterSpanFunction GetRasterSpanFunction(RasterKernel kernel)
+	{
+		switch (kernel)
+		{
+		case RasterKernel::AVX2:
+			return &RasterSpanAVX2;
+		case RasterKernel::SSE:
+			return &RasterSpanSSE;
+		default:
+			return &RasterSpanScalar;
+		}
+	}
+
+	const char* GetRasterKernelName(RasterKernel kernel)
+	{
+		switch (kernel)
+		{
+		case RasterKernel::AVX2:
+			return "AVX2";
+		case RasterKernel::SSE:
+			return "SSE";
+		default:
+			return "Scalar";
+		}
+	}
+}
@@ -0,0 +1,93 @@
+#pragma once
+#include <cstdint>
+
+namespace dae
+{
+	//a span is one row of a triangle inside one tile, so it is never wider than a tile
+	constexpr int MaxSpanLength{ 32 };
+
+	//anything that is linear in screen space (like 1/w and attribute/w), as c + a * offsetX + b * offsetY
+	//the offsets are from the origin of the triangle (RasterTriangle::originX/Y) and c is the value there,
+	//an absolute screen origin would make c big and it would cancel out to nothing far from (0, 0)
+	struct EdgeFunction
+	{
+		float a;
+		float b;
+		float c;
+
+		float Evaluate(float offsetX, float offsetY) const { return a * offsetX + b * offsetY + c; }
+	};
+
+	//vertices get snapped to 1/16th of a pixel, so the coverage test is exact integer math
+	constexpr int SubPixelBits{ 4 };
+	constexpr int SubPixelScale{ 1 << SubPixelBits };
+
+	//same edge function in sub-pixel units, c needs 64 bits but a and b always fit in 32
+	struct FixedEdgeFunction
+	{
+		int64_t a;
+		int64_t b;
+		int64_t c;
+
+		//for the pixel center of (px, py)
+		int64_t Evaluate(int px, int py) const { return a * (int64_t(px) * SubPixelScale + SubPixelScale / 2) + b * (int64_t(py) * SubPixelScale + SubPixelScale / 2) + c; }
+
+		//Edge from -> to with the inside on the side where E >= 0 (clockwise on screen).
+		//Top-left fill rule: pixel centers exactly on a top or left edge are inside, on any other edge they are not,
+		//so two triangles sharing an edge never both draw a pixel. The -1 bias turns the > 0 of the other edges into >= 0.
+		static FixedEdgeFunction FromEdge(int64_t fromX, int64_t fromY, int64_t toX, int64_t toY)
+		{
+			FixedEdgeFunction edge{ fromY - toY, toX - fromX, toY * fromX - toX * fromY };
+			const bool isTopLeft{ edge.a > 0 || (edge.a == 0 && edge.b > 0) };
+			if (!isTopLeft)
+				edge.c -= 1;
+			return edge;
+		}
+	};
+
+	//everything the raster kernels need from a triangle, filled in once during triangle setup
+	struct RasterTriangle
+	{
+		FixedEdgeFunction edge12; //weight of vertex0
+		FixedEdgeFunction edge20; //weight of vertex1
+		FixedEdgeFunction edge01; //weight of vertex2
+		EdgeFunction invW; //1/w over the screen, the depth is 1 over this
+		float originX; //pixel position of vertex 0, every plane of the triangle is relative to it
+		float originY;
+	};
+
+	//integer edge values for one span: E at pixel x + i is start + step * i
+	//the caller makes sure none of them can overflow inside the span
+	struct SpanEdges
+	{
+		int32_t start[3]; //edge12, edge20, edge01
+		int32_t step[3];
+	};
+
+	//per pixel output of a span, only the entries with their bit set in the returned mask are valid
+	struct alignas(32) SpanResult
+	{
+		float depth[MaxSpanLength];
+	};
+
+	//Tests the pixels [x, x + count) of row y against the triangle and the depth buffer.
+	//Pixels that are inside (all edges >= 0) and closer get their depth written to pDepthRow (which points at pixel x)
+	//and their bit set in the returned mask (bit 0 = pixel x).
+	using RasterSpanFunction = uint32_t(*)(const RasterTriangle& triangle, const SpanEdges& edges, int y, int x, int count, float* pDepthRow, SpanResult& result);
+
+	enum class RasterKernel
+	{
+		Scalar,
+		SSE,
+		AVX2
+	};
+
+	uint32_t RasterSpanScalar(const RasterTriangle& triangle, const SpanEdges& edges, int y, int x, int count, float* pDepthRow, SpanResult& result);
+	uint32_t RasterSpanSSE(const RasterTriangle& triangle, const SpanEdges& edges, int y, int x, int count, float* pDepthRow, SpanResult& result);
+	uint32_t RasterSpanAVX2(const RasterTriangle& triangle, const SpanEdges& edges, int y, int x, int count, float* pDepthRow, SpanResult& result);
+
+	//best kernel this cpu can run, checked with cpuid
+	RasterKernel GetBestRasterKernel();
+	RasterSpanFunction GetRasterSpanFunction(RasterKernel kernel);
+	const char* GetRasterKernelName(RasterKernel kernel);
+}
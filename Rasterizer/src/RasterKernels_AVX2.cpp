@@ -0,0 +1,56 @@
+//this file is built with /arch:AVX2, only call into it after GetBestRasterKernel said the cpu can do it
+#include "RasterKernels.h"
+
+#include <cassert>
+#include <immintrin.h>
+
+namespace dae
+{
+	uint32_t RasterSpanAVX2(const RasterTriangle& triangle, const SpanEdges& edges, int y, int x, int count, float* pDepthRow, SpanResult& result)
+	{
+		assert(count <= MaxSpanLength);
+
+		const __m256 one{ _mm256_set1_ps(1.f) };
+		const __m256i minusOne{ _mm256_set1_epi32(-1) };
+		const __m256i laneIndices{ _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7) };
+		const __m256i spanCount{ _mm256_set1_epi32(count) };
+		const __m256 originX{ _mm256_set1_ps(triangle.originX) };
+
+		__m256i signedArea12{ _mm256_add_epi32(_mm256_set1_epi32(edges.start[0]), _mm256_mullo_epi32(_mm256_set1_epi32(edges.step[0]), laneIndices)) };
+		__m256i signedArea20{ _mm256_add_epi32(_mm256_set1_epi32(edges.start[1]), _mm256_mullo_epi32(_mm256_set1_epi32(edges.step[1]), laneIndices)) };
+		__m256i signedArea01{ _mm256_add_epi32(_mm256_set1_epi32(edges.start[2]), _mm256_mullo_epi32(_mm256_set1_epi32(edges.step[2]), laneIndices)) };
+		const __m256i step12{ _mm256_set1_epi32(edges.step[0] * 8) };
+		const __m256i step20{ _mm256_set1_epi32(edges.step[1] * 8) };
+		const __m256i step01{ _mm256_set1_epi32(edges.step[2] * 8) };
+
+		const float pointY{ y + 0.5f - triangle.originY };
+		const __m256 aInvW{ _mm256_set1_ps(triangle.invW.a) };
+		const __m256 rowStartInvW{ _mm256_set1_ps(triangle.invW.b * pointY + triangle.invW.c) };
+
+		uint32_t mask{};
+		for (int i{}; i < count; i += 8, signedArea12 = _mm256_add_epi32(signedArea12, step12), signedArea20 = _mm256_add_epi32(signedArea20, step20), signedArea01 = _mm256_add_epi32(signedArea01, step01))
+		{
+			const __m256i spanIdx{ _mm256_add_epi32(_mm256_set1_epi32(i), laneIndices) };
+
+			//lanes past the end of the span count as outside
+			const __m256i inSpan{ _mm256_cmpgt_epi32(spanCount, spanIdx) };
+			const __m256i insideEdges{ _mm256_cmpgt_epi32(_mm256_or_si256(signedArea12, _mm256_or_si256(signedArea20, signedArea01)), minusOne) };
+			const __m256 inside{ _mm256_castsi256_ps(_mm256_and_si256(inSpan, insideEdges)) };
+			if (_mm256_movemask_ps(inside) == 0)
+				continue;
+
+			//no fma, the depth has to come out the same as in the scalar and sse kernels
+			const __m256 pointX{ _mm256_sub_ps(_mm256_add_ps(_mm256_set1_ps(x + 0.5f), _mm256_cvtepi32_ps(spanIdx)), originX) };
+			const __m256 depth{ _mm256_div_ps(one, _mm256_add_ps(_mm256_mul_ps(aInvW, pointX), rowStartInvW)) };
+
+			//masked so we never touch pixels outside the span (they belong to another tile)
+			const __m256 oldDepth{ _mm256_maskload_ps(pDepthRow + i, inSpan) };
+			const __m256 pass{ _mm256_and_ps(inside, _mm256_cmp_ps(depth, oldDepth, _CMP_LE_OQ)) };
+			_mm256_maskstore_ps(pDepthRow + i, _mm256_castps_si256(pass), depth);
+
+			_mm256_store_ps(result.depth + i, depth);
+			mask |= uint32_t(_mm256_movemask_ps(pass)) << i;
+		}
+		return mask;
+	}
+}
@@ -11,54 +11,152 @@
 #include <iostream>
 #include <limits>
 #include <execution>
+#include <numeric>
+#include <thread>
+#include <bit>
+#include <stdexcept>
 
 using namespace dae;
 
 void dae::Renderer::VertexTransformationFunction(std::vector<Mesh>& meshes) const
 {
-	for (Mesh& mesh : meshes) 
+	//same for every mesh, so only multiply it once
+	const Matrix viewProjection{ m_Camera.viewMatrix * m_Camera.projectionMatrix };
+	Vector4 frustumPlanes[6]{};
+	ExtractFrustumPlanes(viewProjection, frustumPlanes);
+
+	std::vector<VertexChunk> chunks{};
+	for (Mesh& baseMesh : meshes) 
 	{
-		Matrix worldViewProjectionMatrix = mesh.worldMatrix * m_Camera.viewMatrix * m_Camera.projectionMatrix;
+		//instanced meshes share their buffers between the instances, SetupInstances does those one at a time
+		if (!baseMesh.instances.empty())
+			continue;
+
+		//far away meshes draw one of their lods instead, from here on that one goes through like any other mesh
+		baseMesh.activeLod = SelectLod(baseMesh, baseMesh.worldMatrix);
+		Mesh& mesh{ baseMesh.GetActiveLod() };
+		if (&mesh != &baseMesh)
+		{
+			mesh.worldMatrix = baseMesh.worldMatrix;
+			mesh.worldVersion = baseMesh.worldVersion;
+			mesh.cullMode = baseMesh.cullMode;
+		}
+
+		GatherVertexChunks(mesh, viewProjection, frustumPlanes, chunks);
+	}
+
+	TransformVertexChunks(chunks, GetVertexTransformParams(viewProjection));
+}
+
+VertexTransformParams Renderer::GetVertexTransformParams(const Matrix& viewProjection) const
+{
+	/*Normals in NDC on the other hand make no sense We are interested in normals in world
+		space when we do lighting calculations.This means, in the vertex transformation we
+		multiply our normals with the World matrix, NOT the WorldViewProjection matrix*/
+	return VertexTransformParams{
+		viewProjection,
+		m_Camera.origin,
+		float(m_Width),
+		float(m_Height),
+		m_GuardBand };
+}
 
-		mesh.vertices_out.clear();
-		mesh.vertices_out.reserve(mesh.vertices.size());
-		//just add the vertices here
-		for (int vertexIdx{}; vertexIdx < mesh.vertices.size(); vertexIdx++)
+bool Renderer::GatherVertexChunks(Mesh& mesh, const Matrix& viewProjection, const Vector4 frustumPlanes[6], std::vector<VertexChunk>& chunks) const
+{
+	//the kernels read the SoA streams, only rebuilt when the mesh changed
+	const bool isResized{ mesh.vertexStreams.Size() != mesh.vertices.size() };
+	if (isResized)
+	{
+		BuildVertexStreams(mesh.vertices, mesh.vertexStreams);
+		ResizeWorldStreams(mesh.vertices.size(), mesh.worldStreams);
+		mesh.CalculateBounds();
+	}
+
+	//whole mesh outside the frustum, no vertex or triangle work at all
+	//(the cached versions stay old, so it gets transformed again once it comes back)
+	mesh.isVisible = IsMeshVisible(mesh, viewProjection, frustumPlanes);
+	if (!mesh.isVisible)
+		return false;
+
+	//nothing moved since last frame, vertices_out is still good
+	const bool isWorldDirty{ isResized || mesh.transformedWorldVersion != mesh.worldVersion };
+	const bool isCameraDirty{ mesh.transformedCameraVersion != m_Camera.version };
+	if (!isWorldDirty && !isCameraDirty)
+		return true;
+
+	mesh.transformedWorldVersion = mesh.worldVersion;
+	mesh.transformedCameraVersion = m_Camera.version;
+
+	//output is sized up front, every chunk writes its own range so the threads never share anything
+	mesh.vertices_out.resize(mesh.vertices.size());
+	if (mesh.meshlets.empty())
+	{
+		for (size_t first{}; first < mesh.vertices.size(); first += m_VertexChunkSize)
+		{
+			chunks.push_back(VertexChunk{ &mesh, first, std::min(first + m_VertexChunkSize, mesh.vertices.size()), isWorldDirty });
+		}
+		return true;
+	}
+
+	//same culling and versioning again per meshlet, a culled one keeps its old vertices until it comes back
+	for (Meshlet& meshlet : mesh.meshlets)
+	{
+		meshlet.isVisible = IsMeshletVisible(mesh, meshlet, frustumPlanes);
+		if (!meshlet.isVisible)
+			continue;
+
+		const bool isMeshletWorldDirty{ isResized || meshlet.transformedWorldVersion != mesh.worldVersion };
+		if (!isMeshletWorldDirty && meshlet.transformedCameraVersion == m_Camera.version)
+			continue;
+
+		meshlet.transformedWorldVersion = mesh.worldVersion;
+		meshlet.transformedCameraVersion = m_Camera.version;
+
+		//meshlets next to each other also sit next to each other in the vertex arrays, so glue them into one chunk when we can
+		const size_t first{ meshlet.firstVertex };
+		const size_t last{ first + meshlet.vertexCount };
+		VertexChunk* pLastChunk{ chunks.empty() ? nullptr : &chunks.back() };
+		if (pLastChunk && pLastChunk->pMesh == &mesh && pLastChunk->last == first && pLastChunk->isWorldDirty == isMeshletWorldDirty && last - pLastChunk->first <= m_VertexChunkSize)
 		{
-			Vector4 vertexTotransform{ mesh.vertices[vertexIdx].position.x,mesh.vertices[vertexIdx].position.y,mesh.vertices[vertexIdx].position.z,1 };
-			Vector4 vec{ worldViewProjectionMatrix.TransformPoint(vertexTotransform) };
-			bool stayValid = true;
-
-			vec.x /= vec.w;
-			vec.y /= vec.w;
-			vec.z /= vec.w;
-
-			// Do frustum culling
-			if (vec.z < 0.0f || vec.z > 1.0f
-				|| vec.x < -1.0f || vec.x > 1.0f
-				|| vec.y < -1.0f || vec.y > 1.0f)
-				stayValid = false;
-
-
-			/*Normals in NDC on the other hand make no sense We are interested in normals in world
-				space when we do lighting calculations.This means, in the vertex transformation we
-				multiply our normals with the World matrix, NOT the WorldViewProjection matrix*/
-			Vector3 newNormal { mesh.worldMatrix.TransformVector(mesh.vertices[vertexIdx].normal).Normalized()};
-			Vector3 newTangent{ mesh.worldMatrix.TransformVector(mesh.vertices[vertexIdx].tangent).Normalized() };
-			Vector3 vecPosition{ mesh.worldMatrix.TransformPoint(mesh.vertices[vertexIdx].position) };
-
-
-			vec.x = ((vec.x + 1) / 2) * m_Width;
-			vec.y = ((1 - vec.y) / 2) * m_Height;
-			mesh.vertices_out.push_back(Vertex_Out{ vec,
-				mesh.vertices[vertexIdx].color,
-				mesh.vertices[vertexIdx].uv,
-				newNormal,
-				newTangent,
-				{vecPosition - m_Camera.origin},
-				stayValid });
+			pLastChunk->last = last;
+			continue;
 		}
+		chunks.push_back(VertexChunk{ &mesh, first, last, isMeshletWorldDirty });
 	}
+	return true;
+}
+
+void Renderer::TransformVertexChunks(const std::vector<VertexChunk>& chunks, const VertexTransformParams& params) const
+{
+	auto transformChunk = [&](const VertexChunk& chunk)
+		{
+			//world part only when the world matrix changed, a camera move just projects again
+			if (chunk.isWorldDirty)
+			{
+				m_pTransformToWorld(chunk.pMesh->vertexStreams, chunk.pMesh->worldMatrix, chunk.first, chunk.last, chunk.pMesh->worldStreams);
+				m_pPackVertexAttributes(chunk.pMesh->vertexStreams, chunk.pMesh->worldStreams, chunk.first, chunk.last, chunk.pMesh->vertices_out.data());
+			}
+			m_pProjectVertices(chunk.pMesh->worldStreams, params, chunk.first, chunk.last, chunk.pMesh->vertices_out.data());
+		};
+
+	const int numThreads{ m_NumVertexThreads > 0 ? m_NumVertexThreads : int(std::max(1u, std::thread::hardware_concurrency())) };
+	const int numWorkers{ std::min(numThreads, int(chunks.size())) };
+	if (numWorkers <= 1)
+	{
+		std::for_each(chunks.begin(), chunks.end(), transformChunk);
+		return;
+	}
+
+	//one task per thread that takes every numWorkers-th chunk, the policy has no thread count so this is how we cap it
+	std::vector<int> workers(numWorkers);
+	std::iota(workers.begin(), workers.end(), 0);
+	std::for_each(std::execution::par, workers.begin(), workers.end(), [&](int workerIdx)
+		{
+			for (size_t chunkIdx = workerIdx; chunkIdx < chunks.size(); chunkIdx += numWorkers)
+			{
+				transformChunk(chunks[chunkIdx]);
+			}
+		});
 }
 
 Renderer::Renderer(SDL_Window* pWindow) :
@@ -69,19 +167,7 @@ Renderer::Renderer(SDL_Window* pWindow) :
 	 
 	//Create Buffers
 	m_pFrontBuffer = SDL_GetWindowSurface(pWindow);
-	m_pBackBuffer = SDL_CreateRGBSurface(0, m_Width, m_Height, 32, 0, 0, 0, 0);
-	m_pBackBufferPixels = (uint32_t*)m_pBackBuffer->pixels;
-
-	m_pDepthBufferPixels = new float[m_Width * m_Height];
-	for (int pixelIdx = 0; pixelIdx < m_Width * m_Height; pixelIdx++)
-	{
-		m_pDepthBufferPixels[pixelIdx] = std::numeric_limits<float>::max();
-	}
-
-	m_AspectRatio = float(m_Width) / float(m_Height);
-
-	//Initialize Camera
-	m_Camera.Initialize(60.f, { .0f,5.0f,-64.f },float(m_Width) / m_Height);
+	Initialize();
 
 	//m_MeshesWorld = {
 	//	Mesh{
@@ -113,23 +199,104 @@ Renderer::Renderer(SDL_Window* pWindow) :
 	//};
 
 	//mp_Texture = Texture::LoadFromFile("C:/Users/bauwk/Documents/SCHOOL/GRAPHICSPROGRAMMING/GP1_Rasterizer/Rasterizer/Resources/uv_grid_2.png");
-	mp_Texture = Texture::LoadFromFile("Resources/vehicle_diffuse.png");
-	mp_Normal = Texture::LoadFromFile("Resources/vehicle_normal.png");
-	mp_Specular = Texture::LoadFromFile("Resources/vehicle_specular.png");
-	mp_Gloss = Texture::LoadFromFile("Resources/vehicle_gloss.png");
+	Texture* pDiffuse{ Texture::LoadFromFile("Resources/vehicle_diffuse.png") };
+	Texture* pNormal{ Texture::LoadFromFile("Resources/vehicle_normal.png") };
+	Texture* pSpecular{ Texture::LoadFromFile("Resources/vehicle_specular.png") };
+	Texture* pGloss{ Texture::LoadFromFile("Resources/vehicle_gloss.png") };
+
+	//pack the four maps in two so a pixel only does two fetches, gloss only ever used r and specular is (almost) grey
+	mp_DiffuseGloss = Texture::Pack({
+		{ pDiffuse, Texture::Channel::R },
+		{ pDiffuse, Texture::Channel::G },
+		{ pDiffuse, Texture::Channel::B },
+		{ pGloss, Texture::Channel::R } });
+	mp_NormalSpecular = Texture::Pack({
+		{ pNormal, Texture::Channel::R },
+		{ pNormal, Texture::Channel::G },
+		{ pSpecular, Texture::Channel::AverageRGB },
+		{ nullptr, Texture::Channel::One } });
+	delete pDiffuse;
+	delete pNormal;
+	delete pSpecular;
+	delete pGloss;
+
+	//Load/Pack already said what went wrong, without these the first shaded pixel would crash anyway
+	if (!mp_DiffuseGloss || !mp_NormalSpecular)
+	{
+		delete mp_DiffuseGloss;
+		delete mp_NormalSpecular;
+		throw std::runtime_error("Renderer: could not create the vehicle textures");
+	}
 
 	Mesh& mesh = m_MeshesWorld.emplace_back(Mesh{});
 	Utils::ParseOBJ("Resources/vehicle.obj", mesh.vertices, mesh.indices);
 	mesh.primitiveTopology = PrimitiveTopology::TriangleList;
+	//lods before the meshlets, those duplicate the vertices on their borders and the simplifier wants them welded
+	Utils::BuildLodChain(mesh.vertices, mesh.indices, mesh.lods);
+	Utils::BuildMeshlets(mesh.vertices, mesh.indices, mesh.meshlets);
+	mesh.CalculateBounds();
+}
+
+Renderer::Renderer(int width, int height) :
+	m_Width{ width },
+	m_Height{ height }
+{
+	Initialize();
+}
+
+void Renderer::Initialize()
+{
+	m_pBackBuffer = SDL_CreateRGBSurface(0, m_Width, m_Height, 32, 0, 0, 0, 0);
+	m_pBackBufferPixels = (uint32_t*)m_pBackBuffer->pixels;
+
+	//depth and visibility are stored per tile (see GetTiledPixelIdx), so the size is rounded up to whole tiles
+	m_pDepthBufferPixels = new float[GetTiledBufferSize()];
+	for (int pixelIdx = 0; pixelIdx < GetTiledBufferSize(); pixelIdx++)
+	{
+		m_pDepthBufferPixels[pixelIdx] = std::numeric_limits<float>::max();
+	}
+
+	m_pHiZBlockDepth = new float[GetNumHiZBlocks()];
+	std::fill_n(m_pHiZBlockDepth, GetNumHiZBlocks(), FLT_MAX);
+
+	m_pVisibilityBuffer = new uint32_t[GetTiledBufferSize()];
+
+	m_AspectRatio = float(m_Width) / float(m_Height);
+
+	//pick the widest raster kernel this cpu can do
+	m_RasterKernel = GetBestRasterKernel();
+	m_pRasterSpan = GetRasterSpanFunction(m_RasterKernel);
+	m_pTransformToWorld = GetTransformToWorldFunction(m_RasterKernel);
+	m_pProjectVertices = GetProjectVerticesFunction(m_RasterKernel);
+	m_pPackVertexAttributes = GetPackVertexAttributesFunction(m_RasterKernel);
+#ifdef PRINT_STATS
+	std::cout << "Raster kernel: " << GetRasterKernelName(m_RasterKernel) << std::endl;
+#endif
+
+	//cut the screen in tiles, the last row/column can be smaller
+	for (int tileY{}; tileY < m_Height; tileY += m_TileSize)
+	{
+		for (int tileX{}; tileX < m_Width; tileX += m_TileSize)
+		{
+			Tile& tile = m_Tiles.emplace_back(Tile{});
+			tile.boundingBox = BoundingBox{ tileX, std::min(tileY + m_TileSize, m_Height), std::min(tileX + m_TileSize, m_Width), tileY };
+			tile.maxDepth = FLT_MAX;
+			tile.bufferOffset = int(m_Tiles.size() - 1) * m_TileSize * m_TileSize;
+		}
+	}
+
+	//Initialize Camera
+	m_Camera.Initialize(60.f, { .0f,5.0f,-64.f },float(m_Width) / m_Height);
 }
 
 Renderer::~Renderer()
 {
+	SDL_FreeSurface(m_pBackBuffer);
 	delete[] m_pDepthBufferPixels;
-	delete mp_Texture;
-	delete mp_Normal;
-	delete mp_Specular;
-	delete mp_Gloss;
+	delete[] m_pHiZBlockDepth;
+	delete[] m_pVisibilityBuffer;
+	delete mp_DiffuseGloss;
+	delete mp_NormalSpecular;
 }
 
 void Renderer::Update(Timer* pTimer)
@@ -144,7 +311,7 @@ void Renderer::Update(Timer* pTimer)
 		{
 			Matrix translationMatrix = Matrix::CreateTranslation(0.f, 0.f, 50.f);
 			Matrix rotationMatrix = Matrix::CreateRotationY(m_CurrentMeshRotation);
-			mesh.worldMatrix = rotationMatrix * translationMatrix;
+			mesh.SetWorldMatrix(rotationMatrix * translationMatrix);
 		}
 	}
 }
@@ -154,228 +321,893 @@ void Renderer::Render()
 	//@START
 	//Lock BackBuffer
 	SDL_LockSurface(m_pBackBuffer);
-	std::fill_n(m_pDepthBufferPixels, m_Width * m_Height, FLT_MAX);
+	std::fill_n(m_pDepthBufferPixels, GetTiledBufferSize(), FLT_MAX);
+	std::fill_n(m_pHiZBlockDepth, GetNumHiZBlocks(), FLT_MAX);
 	SDL_FillRect(m_pBackBuffer, &m_pBackBuffer->clip_rect, SDL_MapRGB(m_pBackBuffer->format, 100, 100, 100)); //clear screen
-	
+
 	VertexTransformationFunction(m_MeshesWorld);
 
-		for (Mesh& mesh : m_MeshesWorld)
+	m_Triangles.clear();
+	for (Mesh& baseMesh : m_MeshesWorld)
+	{
+		if (!baseMesh.instances.empty())
+		{
+			SetupInstances(baseMesh);
+			continue;
+		}
+
+		const Mesh& mesh{ baseMesh.GetActiveLod() };
+		if (!mesh.isVisible)
+			continue;
+
+		SetupTriangles(mesh);
+	}
+	BinTriangles();
+
+	//every tile only touches its own pixels so no locks needed on the buffers
+	std::for_each(std::execution::par, m_Tiles.begin(), m_Tiles.end(), [this](Tile& tile)
+		{
+			RenderTile(tile);
+		});
+
+	//@END
+	//Update SDL Surface
+	SDL_UnlockSurface(m_pBackBuffer);
+	SDL_BlitSurface(m_pBackBuffer, 0, m_pFrontBuffer, 0);
+	SDL_UpdateWindowSurface(m_pWindow);
+}
+
+void Renderer::SetupInstances(Mesh& mesh)
+{
+	const Matrix viewProjection{ m_Camera.viewMatrix * m_Camera.projectionMatrix };
+	Vector4 frustumPlanes[6]{};
+	ExtractFrustumPlanes(viewProjection, frustumPlanes);
+	const VertexTransformParams params{ GetVertexTransformParams(viewProjection) };
+
+	//setup copies everything it needs out of vertices_out, so the next instance can overwrite it right after
+	//that keeps the memory at one copy of the vertex buffers no matter how many instances there are
+	std::vector<VertexChunk> chunks{};
+	for (MeshInstance& instance : mesh.instances)
+	{
+		instance.activeLod = SelectLod(mesh, instance.worldMatrix);
+		Mesh& lod{ mesh.GetLod(instance.activeLod) };
+		lod.SetWorldMatrix(instance.worldMatrix);
+		lod.cullMode = mesh.cullMode;
+
+		chunks.clear();
+		instance.isVisible = GatherVertexChunks(lod, viewProjection, frustumPlanes, chunks);
+		if (!instance.isVisible)
+			continue;
+
+		TransformVertexChunks(chunks, params);
+		SetupTriangles(lod);
+	}
+}
+
+void Renderer::ExtractFrustumPlanes(const Matrix& matrix, Vector4 planes[6])
+{
+	//we multiply row vectors, so clip.x is dot((p, 1), column 0) and every clip plane is a sum of columns
+	const Vector4 column0{ matrix[0].x, matrix[1].x, matrix[2].x, matrix[3].x };
+	const Vector4 column1{ matrix[0].y, matrix[1].y, matrix[2].y, matrix[3].y };
+	const Vector4 column2{ matrix[0].z, matrix[1].z, matrix[2].z, matrix[3].z };
+	const Vector4 column3{ matrix[0].w, matrix[1].w, matrix[2].w, matrix[3].w };
+
+	planes[0] = column3 + column0; //left, x >= -w
+	planes[1] = column3 - column0; //right, x <= w
+	planes[2] = column3 + column1; //bottom, y >= -w
+	planes[3] = column3 - column1; //top, y <= w
+	planes[4] = column2; //near, z >= 0
+	planes[5] = column3 - column2; //far, z <= w
+}
+
+bool Renderer::IsMeshVisible(const Mesh& mesh, const Matrix& viewProjection, const Vector4 frustumPlanes[6])
+{
+	//sphere first, scaled by the biggest axis so it still covers everything with a non uniform scale
+	const Vector3 center{ mesh.worldMatrix.TransformPoint(mesh.boundsCenter) };
+	const float maxSqrScale{ std::max(mesh.worldMatrix.GetAxisX().SqrMagnitude(), std::max(mesh.worldMatrix.GetAxisY().SqrMagnitude(), mesh.worldMatrix.GetAxisZ().SqrMagnitude())) };
+	const float radius{ mesh.boundsRadius * std::sqrt(maxSqrScale) };
+	for (int planeIdx{}; planeIdx < 6; ++planeIdx)
+	{
+		const Vector4& plane{ frustumPlanes[planeIdx] };
+		const Vector3 normal{ plane.x, plane.y, plane.z };
+		if (Vector3::Dot(normal, center) + plane.w < -radius * normal.Magnitude())
+			return false;
+	}
+
+	//the box is tighter, bring the planes to object space and test the corner that is the farthest along each normal
+	Vector4 objectPlanes[6]{};
+	ExtractFrustumPlanes(mesh.worldMatrix * viewProjection, objectPlanes);
+	for (const Vector4& plane : objectPlanes)
+	{
+		const Vector3 corner{
+			plane.x >= 0.f ? mesh.boundsMax.x : mesh.boundsMin.x,
+			plane.y >= 0.f ? mesh.boundsMax.y : mesh.boundsMin.y,
+			plane.z >= 0.f ? mesh.boundsMax.z : mesh.boundsMin.z };
+		if (plane.x * corner.x + plane.y * corner.y + plane.z * corner.z + plane.w < 0.f)
+			return false;
+	}
+	return true;
+}
+
+int Renderer::SelectLod(const Mesh& mesh, const Matrix& world) const
+{
+	if (mesh.lods.empty())
+		return 0;
+
+	//distance to the closest point of the bounding sphere, inside it we always want the full mesh
+	const Vector3 center{ world.TransformPoint(mesh.boundsCenter) };
+	const float maxScale{ std::sqrt(std::max(world.GetAxisX().SqrMagnitude(), std::max(world.GetAxisY().SqrMagnitude(), world.GetAxisZ().SqrMagnitude()))) };
+	const float distance{ (center - m_Camera.origin).Magnitude() - mesh.boundsRadius * maxScale };
+	if (distance <= 0.f)
+		return 0;
+
+	//pixels one world unit covers at that distance, the projection scales y by [1][1] and ndc is half the screen
+	const float pixelsPerUnit{ 0.5f * float(m_Height) * m_Camera.projectionMatrix[1][1] / distance };
+
+	int lod{};
+	while (lod < int(mesh.lods.size()) && mesh.lods[lod].lodError * maxScale * pixelsPerUnit <= m_LodPixelError)
+	{
+		++lod;
+	}
+	return lod;
+}
+
+bool Renderer::IsMeshletVisible(const Mesh& mesh, const Meshlet& meshlet, const Vector4 frustumPlanes[6]) const
+{
+	const Matrix& world{ mesh.worldMatrix };
+	const Vector3 center{ world.TransformPoint(meshlet.center) };
+	const float maxSqrScale{ std::max(world.GetAxisX().SqrMagnitude(), std::max(world.GetAxisY().SqrMagnitude(), world.GetAxisZ().SqrMagnitude())) };
+	const float radius{ meshlet.radius * std::sqrt(maxSqrScale) };
+	for (int planeIdx{}; planeIdx < 6; ++planeIdx)
+	{
+		const Vector4& plane{ frustumPlanes[planeIdx] };
+		const Vector3 normal{ plane.x, plane.y, plane.z };
+		if (Vector3::Dot(normal, center) + plane.w < -radius * normal.Magnitude())
+			return false;
+	}
+
+	//normal cone: when the camera sees every face of the meshlet from behind, the whole thing gets culled anyway
+	if (mesh.cullMode == CullMode::None || meshlet.coneCutoff >= 1.f)
+		return true;
+
+	Vector3 coneAxis{ world.TransformVector(meshlet.coneAxis).Normalized() };
+	if (mesh.cullMode == CullMode::Front)
+		coneAxis = -coneAxis;
+
+	const Vector3 toCenter{ center - m_Camera.origin };
+	return Vector3::Dot(toCenter, coneAxis) < meshlet.coneCutoff * toCenter.Magnitude() + radius;
+}
+
+void Renderer::SetupTriangles(const Mesh& mesh)
+{
+	int numTriangles{};
+	switch (mesh.primitiveTopology)
+	{
+	case dae::PrimitiveTopology::TriangleList: //first one
+		numTriangles = mesh.indices.size() / 3;
+		break;
+	case dae::PrimitiveTopology::TriangleStrip: //second one
+		numTriangles = mesh.indices.size() - 2;
+		break;
+	}
+
+	//post-transform cache: neighbouring triangles share vertices, so keep their snapped position and packed attributes around
+	struct CachedSetupVertex
+	{
+		uint32_t index;
+		SetupVertex vertex;
+	};
+	CachedSetupVertex setupCache[m_SetupCacheSize];
+	for (CachedSetupVertex& cached : setupCache)
+	{
+		cached.index = UINT32_MAX;
+	}
+
+	auto fetchSetupVertex = [&](uint32_t index) -> SetupVertex&
 		{
-			int numTriangles{};
+			CachedSetupVertex& cached{ setupCache[index % m_SetupCacheSize] };
+			if (cached.index != index)
+			{
+				cached.index = index;
+				PrepareSetupVertex(mesh.vertices_out[index], cached.vertex);
+			}
+			return cached.vertex;
+		};
+
+	//culled meshlets are skipped as a whole, without meshlets it is just one range with everything
+	struct TriangleRange
+	{
+		int first;
+		int last;
+	};
+	std::vector<TriangleRange> ranges{};
+	if (mesh.meshlets.empty())
+	{
+		ranges.push_back(TriangleRange{ 0, numTriangles });
+	}
+	for (const Meshlet& meshlet : mesh.meshlets)
+	{
+		if (!meshlet.isVisible)
+			continue;
+
+		const int first{ int(meshlet.firstTriangle) };
+		if (!ranges.empty() && ranges.back().last == first)
+			ranges.back().last += meshlet.triangleCount;
+		else
+			ranges.push_back(TriangleRange{ first, first + int(meshlet.triangleCount) });
+	}
+
+	for (const TriangleRange& range : ranges)
+	{
+		for (int indiceIdx = range.first; indiceIdx < range.last; ++indiceIdx)
+		{
+			uint32_t indxVector0{ };
+			uint32_t indxVector1{ };
+			uint32_t indxVector2{ };
 			switch (mesh.primitiveTopology)
 			{
-			case dae::PrimitiveTopology::TriangleList: //first one
-				numTriangles = mesh.indices.size() / 3;
-				break;
-			case dae::PrimitiveTopology::TriangleStrip: //second one
-				numTriangles = mesh.indices.size() - 2;
+			case PrimitiveTopology::TriangleList:
+				indxVector0 = mesh.indices[indiceIdx * 3];
+				indxVector1 = mesh.indices[indiceIdx * 3 + 1];
+				indxVector2 = mesh.indices[indiceIdx * 3 + 2];
 				break;
+			case PrimitiveTopology::TriangleStrip:
+				indxVector0 = mesh.indices[indiceIdx];
+				indxVector1 = mesh.indices[indiceIdx + 1];
+				indxVector2 = mesh.indices[indiceIdx + 2];
+				if (indiceIdx % 2 == 1)
+				{
+					std::swap(indxVector1, indxVector2); //make every other triangle rotate the other way
+				}
+
+				// not a triangle so skip
+				if (indxVector0 == indxVector1 || indxVector2 == indxVector0 || indxVector1 == indxVector2)
+					continue;
+			}
+
+			const Vertex_Out& vertex0{ mesh.vertices_out[indxVector0] };
+			const Vertex_Out& vertex1{ mesh.vertices_out[indxVector1] };
+			const Vertex_Out& vertex2{ mesh.vertices_out[indxVector2] };
+
+			//all three outside the same plane means it can never be on screen
+			if ((vertex0.clipFlags & vertex1.clipFlags & vertex2.clipFlags & ClipFrustum) != 0)
+				continue;
+
+			//only clip when we have to, the screen edges are handled by the guard band and the bounding box clamp
+			if (((vertex0.clipFlags | vertex1.clipFlags | vertex2.clipFlags) & ClipNeeded) != 0)
+			{
+				ClipTriangle(vertex0, vertex1, vertex2, mesh.cullMode);
+				continue;
+			}
+
+			//a vertex that shares a slot with another one of the same triangle would get overwritten while we use it
+			const uint32_t slot0{ indxVector0 % m_SetupCacheSize };
+			const uint32_t slot1{ indxVector1 % m_SetupCacheSize };
+			const uint32_t slot2{ indxVector2 % m_SetupCacheSize };
+			if ((slot0 == slot1 && indxVector0 != indxVector1) || (slot1 == slot2 && indxVector1 != indxVector2) || (slot2 == slot0 && indxVector2 != indxVector0))
+			{
+				SetupTriangle(vertex0, vertex1, vertex2, mesh.cullMode);
+				continue;
+			}
+
+			SetupTriangle(fetchSetupVertex(indxVector0), fetchSetupVertex(indxVector1), fetchSetupVertex(indxVector2), mesh.cullMode);
+		}
+	}
+}
+
+void Renderer::ClipTriangle(const Vertex_Out& vertex0, const Vertex_Out& vertex1, const Vertex_Out& vertex2, CullMode cullMode)
+{
+	Vertex_Out polygon[m_MaxClipVertices]{};
+	const int numVertices{ ClipPolygon(vertex0, vertex1, vertex2, polygon) };
+
+	//fan it back into triangles, clipping keeps the winding
+	for (int vertexIdx{ 1 }; vertexIdx + 1 < numVertices; ++vertexIdx)
+	{
+		SetupTriangle(polygon[0], polygon[vertexIdx], polygon[vertexIdx + 1], cullMode);
+	}
+}
+
+int Renderer::ClipPolygon(const Vertex_Out& vertex0, const Vertex_Out& vertex1, const Vertex_Out& vertex2, Vertex_Out polygon[]) const
+{
+	//planes as dot(plane, clip position) >= 0 means inside
+	const Vector4 clipPlanes[]{
+		{ 0.f, 0.f, 1.f, 0.f }, //near: z >= 0
+		{ 0.f, 0.f, -1.f, 1.f }, //far: z <= w
+		{ 1.f, 0.f, 0.f, m_GuardBand }, //guard band left
+		{ -1.f, 0.f, 0.f, m_GuardBand }, //guard band right
+		{ 0.f, 1.f, 0.f, m_GuardBand }, //guard band bottom
+		{ 0.f, -1.f, 0.f, m_GuardBand } //guard band top
+	};
+
+	polygon[0] = ToClipSpace(vertex0);
+	polygon[1] = ToClipSpace(vertex1);
+	polygon[2] = ToClipSpace(vertex2);
+	Vertex_Out clipped[m_MaxClipVertices]{};
+	int numVertices{ 3 };
+
+	const uint8_t clipFlags{ uint8_t(vertex0.clipFlags | vertex1.clipFlags | vertex2.clipFlags) };
+	for (int planeIdx{}; planeIdx < 6; ++planeIdx)
+	{
+		//skip the planes nobody is outside of
+		const bool isGuardBandPlane{ planeIdx >= 2 };
+		if ((planeIdx == 0 && !(clipFlags & ClipNear)) || (planeIdx == 1 && !(clipFlags & ClipFar)) || (isGuardBandPlane && !(clipFlags & ClipGuardBand)))
+			continue;
+
+		//Sutherland-Hodgman, keep the inside part of every edge
+		int numClipped{};
+		for (int vertexIdx{}; vertexIdx < numVertices; ++vertexIdx)
+		{
+			const Vertex_Out& current{ polygon[vertexIdx] };
+			const Vertex_Out& next{ polygon[(vertexIdx + 1) % numVertices] };
+			const float currentDistance{ Vector4::Dot(clipPlanes[planeIdx], current.position) };
+			const float nextDistance{ Vector4::Dot(clipPlanes[planeIdx], next.position) };
+
+			if (currentDistance >= 0.f)
+				clipped[numClipped++] = current;
+
+			if ((currentDistance >= 0.f) != (nextDistance >= 0.f))
+				clipped[numClipped++] = LerpVertex(current, next, currentDistance / (currentDistance - nextDistance));
+		}
+
+		numVertices = numClipped;
+		if (numVertices < 3)
+			return 0;
+
+		std::copy(clipped, clipped + numVertices, polygon);
+	}
+
+	for (int vertexIdx{}; vertexIdx < numVertices; ++vertexIdx)
+	{
+		polygon[vertexIdx] = ToScreenSpace(polygon[vertexIdx]);
+	}
+	return numVertices;
+}
+
+Vertex_Out Renderer::ToClipSpace(const Vertex_Out& vertex) const
+{
+	//vertices that needed clipping never got the perspective divide
+	if ((vertex.clipFlags & ClipNeeded) != 0)
+		return vertex;
+
+	Vertex_Out clipVertex{ vertex };
+	const float w{ vertex.position.w };
+	clipVertex.position.x = (vertex.position.x / m_Width * 2.f - 1.f) * w;
+	clipVertex.position.y = (1.f - vertex.position.y / m_Height * 2.f) * w;
+	clipVertex.position.z = vertex.position.z * w;
+	return clipVertex;
+}
+
+Vertex_Out Renderer::ToScreenSpace(const Vertex_Out& vertex) const
+{
+	Vertex_Out screenVertex{ vertex };
+	const float w{ vertex.position.w };
+	screenVertex.position.x = ((vertex.position.x / w + 1) / 2) * m_Width;
+	screenVertex.position.y = ((1 - vertex.position.y / w) / 2) * m_Height;
+	screenVertex.position.z = vertex.position.z / w;
+	screenVertex.clipFlags = 0;
+	return screenVertex;
+}
+
+Vertex_Out Renderer::LerpVertex(const Vertex_Out& from, const Vertex_Out& to, float factor)
+{
+	//in clip space everything is still linear so a normal lerp is fine
+	Vertex_Out lerped{};
+	lerped.position = from.position + (to.position - from.position) * factor;
+	lerped.SetNormal(from.GetNormal() + (to.GetNormal() - from.GetNormal()) * factor);
+	lerped.SetTangent(from.GetTangent() + (to.GetTangent() - from.GetTangent()) * factor);
+	lerped.SetUV(from.GetUV() + (to.GetUV() - from.GetUV()) * factor);
+	lerped.SetViewDirection(from.GetViewDirection() + (to.GetViewDirection() - from.GetViewDirection()) * factor);
+	lerped.clipFlags = from.clipFlags;
+	//white on both sides stays white without unpacking anything
+	if (((from.flags | to.flags) & VertexHasColor) != 0)
+	{
+		lerped.SetColor(ColorRGB::Lerp(from.GetColor(), to.GetColor(), factor));
+	}
+	return lerped;
+}
+
+void Renderer::SetupTriangle(const Vertex_Out& vertex0, const Vertex_Out& vertex1, const Vertex_Out& vertex2, CullMode cullMode)
+{
+	//clipped vertices are new every time, so nothing to cache
+	SetupVertex setupVertex0, setupVertex1, setupVertex2;
+	PrepareSetupVertex(vertex0, setupVertex0);
+	PrepareSetupVertex(vertex1, setupVertex1);
+	PrepareSetupVertex(vertex2, setupVertex2);
+	SetupTriangle(setupVertex0, setupVertex1, setupVertex2, cullMode);
+}
+
+void Renderer::PrepareSetupVertex(const Vertex_Out& vertex, SetupVertex& setupVertex)
+{
+	setupVertex.pVertex = &vertex;
+	setupVertex.isPacked = false;
+
+	//clipping keeps the positions inside the guard band, anything else here is broken input
+	setupVertex.isValid = std::isfinite(vertex.position.x + vertex.position.y);
+	if (!setupVertex.isValid)
+		return;
+
+	//snap to the sub-pixel grid, after this everything that decides coverage is exact integer math
+	setupVertex.fixedX = std::llround(vertex.position.x * SubPixelScale);
+	setupVertex.fixedY = std::llround(vertex.position.y * SubPixelScale);
+	setupVertex.invW = 1.f / vertex.position.w;
+}
+
+void Renderer::SetupTriangle(SetupVertex& vertex0, SetupVertex& vertex1, SetupVertex& vertex2, CullMode cullMode)
+{
+	if (!vertex0.isValid || !vertex1.isValid || !vertex2.isValid)
+		return;
+
+	const int64_t fixedX0{ vertex0.fixedX };
+	const int64_t fixedY0{ vertex0.fixedY };
+	const int64_t fixedX1{ vertex1.fixedX };
+	const int64_t fixedY1{ vertex1.fixedY };
+	const int64_t fixedX2{ vertex2.fixedX };
+	const int64_t fixedY2{ vertex2.fixedY };
+
+	//signed area once per triangle, positive is clockwise on screen (y goes down) which is our front face
+	const int64_t fixedArea{ (fixedX1 - fixedX0) * (fixedY2 - fixedY0) - (fixedY1 - fixedY0) * (fixedX2 - fixedX0) };
+
+	//no area means no pixels, and it would divide by zero later
+	if (fixedArea == 0)
+		return;
+
+	const bool isFrontFacing{ fixedArea > 0 };
+	if ((cullMode == CullMode::Back && !isFrontFacing) || (cullMode == CullMode::Front && isFrontFacing))
+		return;
+
+	//the raster only handles the front winding, so flip the ones that are left
+	if (!isFrontFacing)
+	{
+		SetupTriangle(vertex0, vertex2, vertex1, CullMode::None);
+		return;
+	}
+
+	//Bouding Box ---------------
+	//tight: only the pixels whose center can be inside, so sub-pixel triangles that miss every center end up empty
+	const int64_t minFixedX{ std::min(fixedX0, std::min(fixedX1, fixedX2)) };
+	const int64_t maxFixedX{ std::max(fixedX0, std::max(fixedX1, fixedX2)) };
+	const int64_t minFixedY{ std::min(fixedY0, std::min(fixedY1, fixedY2)) };
+	const int64_t maxFixedY{ std::max(fixedY0, std::max(fixedY1, fixedY2)) };
+
+	//first and last pixel center inside the range (centers are at px * SubPixelScale + SubPixelScale / 2)
+	auto firstPixel = [](int64_t fixedMin) { return int(std::ceil(float(fixedMin - SubPixelScale / 2) / SubPixelScale)); };
+	auto lastPixel = [](int64_t fixedMax) { return int(std::floor(float(fixedMax - SubPixelScale / 2) / SubPixelScale)); };
+
+	//clamp so it does not go out of bounds
+	const int minX{ Clamp(firstPixel(minFixedX), 0, m_Width) };
+	const int maxX{ Clamp(lastPixel(maxFixedX) + 1, 0, m_Width) };
+	const int minY{ Clamp(firstPixel(minFixedY), 0, m_Height) };
+	const int maxY{ Clamp(lastPixel(maxFixedY) + 1, 0, m_Height) };
+	//---------------
+
+	if (minX >= maxX || minY >= maxY)
+		return;
+
+	//attribute planes use the snapped positions too so they line up with the coverage
+	//they start at vertex 0 and go from there, the deltas come from the integer positions so they are exact
+	const float deltaX1{ float(fixedX1 - fixedX0) / SubPixelScale };
+	const float deltaY1{ float(fixedY1 - fixedY0) / SubPixelScale };
+	const float deltaX2{ float(fixedX2 - fixedX0) / SubPixelScale };
+	const float deltaY2{ float(fixedY2 - fixedY0) / SubPixelScale };
+
+	//value = value0 + a * (x - x0) + b * (y - y0), solved so it also hits value1 and value2
+	const float invDoubleArea{ float(SubPixelScale * SubPixelScale) / float(fixedArea) };
+	auto makePlane = [&](float value0, float value1, float value2)
+		{
+			const float delta1{ value1 - value0 };
+			const float delta2{ value2 - value0 };
+			return EdgeFunction{
+				(delta1 * deltaY2 - delta2 * deltaY1) * invDoubleArea,
+				(delta2 * deltaX1 - delta1 * deltaX2) * invDoubleArea,
+				value0 };
+		};
+
+	const RasterTriangle raster{
+		FixedEdgeFunction::FromEdge(fixedX1, fixedY1, fixedX2, fixedY2),
+		FixedEdgeFunction::FromEdge(fixedX2, fixedY2, fixedX0, fixedY0),
+		FixedEdgeFunction::FromEdge(fixedX0, fixedY0, fixedX1, fixedY1),
+		makePlane(vertex0.invW, vertex1.invW, vertex2.invW),
+		float(fixedX0) / SubPixelScale,
+		float(fixedY0) / SubPixelScale };
+
+	//only pack once per vertex, the cache hands the same one to the next triangles
+	for (SetupVertex* pSetupVertex : { &vertex0, &vertex1, &vertex2 })
+	{
+		if (!pSetupVertex->isPacked)
+		{
+			PackAttributes(*pSetupVertex->pVertex, pSetupVertex->invW, pSetupVertex->values);
+			pSetupVertex->isPacked = true;
+		}
+	}
+
+	AttributePlanes attributes{};
+	for (int valueIdx{}; valueIdx < AttributePlanes::NumValues; ++valueIdx)
+	{
+		attributes.values[valueIdx] = makePlane(vertex0.values[valueIdx], vertex1.values[valueIdx], vertex2.values[valueIdx]);
+	}
+
+	const Vector4& vertex0Pos{ vertex0.pVertex->position };
+	const Vector4& vertex1Pos{ vertex1.pVertex->position };
+	const Vector4& vertex2Pos{ vertex2.pVertex->position };
+	attributes.z = makePlane(vertex0Pos.z, vertex1Pos.z, vertex2Pos.z);
+
+	//depth is the interpolated w, so it never gets closer than the closest vertex
+	const float minDepth{ std::min(vertex0Pos.w, std::min(vertex1Pos.w, vertex2Pos.w)) };
+
+	m_Triangles.push_back(TriangleSetup{ attributes, raster, minDepth, BoundingBox{ minX, maxY, maxX, minY } });
+}
+
+void Renderer::PackAttributes(const Vertex_Out& vertex, float invW, float values[AttributePlanes::NumValues])
+{
+	const Vector2 uv{ vertex.GetUV() };
+	const ColorRGB color{ vertex.GetColor() };
+	const Vector3 normal{ vertex.GetNormal() };
+	const Vector3 tangent{ vertex.GetTangent() };
+	const Vector3 viewDirection{ vertex.GetViewDirection() };
+
+	//same order as AttributePlanes::values
+	const float unpacked[AttributePlanes::NumValues]{
+		uv.x, uv.y,
+		color.r, color.g, color.b,
+		normal.x, normal.y, normal.z,
+		tangent.x, tangent.y, tangent.z,
+		viewDirection.x, viewDirection.y, viewDirection.z };
+
+	for (int valueIdx{}; valueIdx < AttributePlanes::NumValues; ++valueIdx)
+	{
+		values[valueIdx] = unpacked[valueIdx] * invW;
+	}
+}
+
+void Renderer::BinTriangles()
+{
+	for (Tile& tile : m_Tiles)
+	{
+		tile.triangleIndices.clear();
+	}
+
+	const int numTilesX{ (m_Width + m_TileSize - 1) / m_TileSize };
+
+	//drop every triangle in all the tiles its bounding box touches, keeps the order so depth ties stay the same
+	for (uint32_t triangleIdx{}; triangleIdx < m_Triangles.size(); ++triangleIdx)
+	{
+		const BoundingBox& box{ m_Triangles[triangleIdx].boundingBox };
+
+		const int firstTileX{ box.left / m_TileSize };
+		const int lastTileX{ (box.right - 1) / m_TileSize };
+		const int firstTileY{ box.top / m_TileSize };
+		const int lastTileY{ (box.bottom - 1) / m_TileSize };
+
+		for (int tileY{ firstTileY }; tileY <= lastTileY; ++tileY)
+		{
+			for (int tileX{ firstTileX }; tileX <= lastTileX; ++tileX)
+			{
+				m_Tiles[tileX + tileY * numTilesX].triangleIndices.push_back(triangleIdx);
 			}
+		}
+	}
+}
+
+void Renderer::RenderTile(Tile& tile)
+{
+	tile.maxDepth = FLT_MAX;
+
+	if (m_DeferredShadingEnabled)
+	{
+		std::fill_n(m_pVisibilityBuffer + tile.bufferOffset, m_TileSize * m_TileSize, m_NoTriangle);
+	}
+
+	for (const uint32_t triangleIdx : tile.triangleIndices)
+	{
+		RasterizeTriangle(triangleIdx, tile);
+	}
+
+	if (m_DeferredShadingEnabled)
+	{
+		ShadeVisibilityBuffer(tile);
+	}
+}
+
+template<typename Function>
+void Renderer::WithMaterialSampler(Function&& function) const
+{
+	//both textures always get the same modes (ToggleSampleMode), the mask is only right when both are powers of two
+	const bool isPowerOfTwo{ mp_DiffuseGloss->IsPowerOfTwo() && mp_NormalSpecular->IsPowerOfTwo() };
+	Texture::DispatchSampleModes(mp_DiffuseGloss->GetSampleMode(), mp_DiffuseGloss->GetAddressMode(), isPowerOfTwo, function);
+}
 
-			for (int indiceIdx = 0; indiceIdx < numTriangles; ++indiceIdx)
+void Renderer::ShadeVisibilityBuffer(const Tile& tile)
+{
+	//every pixel gets shaded once, by the triangle that ended up in front
+	WithMaterialSampler([&]<SampleMode sampleMode, AddressMode addressMode, bool isPowerOfTwo>()
+		{
+			const BoundingBox& tileBox{ tile.boundingBox };
+			for (int py{ tileBox.top }; py < tileBox.bottom; ++py)
 			{
-				uint32_t indxVector0{ };
-				uint32_t indxVector1{ };
-				uint32_t indxVector2{ };
-				switch (mesh.primitiveTopology)
+				for (int px{ tileBox.left }; px < tileBox.right; ++px)
 				{
-				case PrimitiveTopology::TriangleList:
-					indxVector0 = mesh.indices[indiceIdx * 3];
-					indxVector1 = mesh.indices[indiceIdx * 3 + 1];
-					indxVector2 = mesh.indices[indiceIdx * 3 + 2];
-					break;
-				case PrimitiveTopology::TriangleStrip:
-					indxVector0 = mesh.indices[indiceIdx];
-					indxVector1 = mesh.indices[indiceIdx + 1];
-					indxVector2 = mesh.indices[indiceIdx + 2];
-					if (indiceIdx % 2 == 1)
-					{
-						std::swap(indxVector1, indxVector2); //make every other triangle rotate the other way
-					}
-
-					// not a triangle so skip
-					if (indxVector0 == indxVector1 || indxVector2 == indxVector0 || indxVector1 == indxVector2)
+					const int tiledPixelIdx{ GetTiledPixelIdx(tile, px, py) };
+					const uint32_t triangleIdx{ m_pVisibilityBuffer[tiledPixelIdx] };
+					if (triangleIdx == m_NoTriangle)
 						continue;
+
+					//the attribute planes only need the pixel position and the depth, so nothing else to keep around
+					WritePixel(px + (py * m_Width), ShadeFragment<sampleMode, addressMode, isPowerOfTwo>(m_Triangles[triangleIdx], Vector2{ px + 0.5f, py + 0.5f }, m_pDepthBufferPixels[tiledPixelIdx]));
 				}
+			}
+		});
+}
 
-				const Vertex_Out vertex0{ mesh.vertices_out[indxVector0] };
-				const Vertex_Out vertex1{ mesh.vertices_out[indxVector1] };
-				const Vertex_Out vertex2{ mesh.vertices_out[indxVector2] };
+template<SampleMode sampleMode, AddressMode addressMode, bool isPowerOfTwo>
+void Renderer::ShadeSpan(const TriangleSetup& triangle, int py, int spanStart, uint32_t coverage, const SpanResult& span)
+{
+	while (coverage != 0)
+	{
+		const int spanIdx{ std::countr_zero(coverage) };
+		coverage &= coverage - 1;
 
-				const Vector4 vertex0Pos{ mesh.vertices_out[indxVector0].position };
-				const Vector4 vertex1Pos{ mesh.vertices_out[indxVector1].position };
-				const Vector4 vertex2Pos{ mesh.vertices_out[indxVector2].position };
+		const int px{ spanStart + spanIdx };
+		WritePixel(px + (py * m_Width), ShadeFragment<sampleMode, addressMode, isPowerOfTwo>(triangle, Vector2{ px + 0.5f, py + 0.5f }, span.depth[spanIdx]));
+	}
+}
 
-				if (!vertex0.valid || !vertex1.valid || !vertex2.valid)
-					continue;
+void Renderer::WritePixel(int pixelIdx, ColorRGB color)
+{
+	//Update Color in Buffer
+	color.MaxToOne();
+	m_pBackBufferPixels[pixelIdx] = SDL_MapRGB(m_pBackBuffer->format,
+		static_cast<uint8_t>(color.r * 255),
+		static_cast<uint8_t>(color.g * 255),
+		static_cast<uint8_t>(color.b * 255));
+}
 
-				//Bouding Box ---------------
-				const Vector3 edge10{ vertex1Pos - vertex0Pos };
-				const Vector3 edge21{ vertex2Pos - vertex1Pos };
-				const Vector3 edge02{ vertex0Pos - vertex2Pos };
+void Renderer::RasterizeTriangle(uint32_t triangleIdx, Tile& tile)
+{
+	const TriangleSetup& triangle{ m_Triangles[triangleIdx] };
+
+	//whole triangle is behind everything that is already in this tile
+	if (triangle.minDepth > tile.maxDepth)
+		return;
+
+	const BoundingBox& tileBox{ tile.boundingBox };
+
+	//only the part of the bounding box that is inside this tile
+	const int minX{ std::max(triangle.boundingBox.left, tileBox.left) };
+	const int maxX{ std::min(triangle.boundingBox.right, tileBox.right) };
+	const int minY{ std::max(triangle.boundingBox.top, tileBox.top) };
+	const int maxY{ std::min(triangle.boundingBox.bottom, tileBox.bottom) };
+
+	//check every edge against the corners of that box: all outside means we can skip this tile,
+	//all inside means the edge does not matter here. Only edges that cross it get tested per pixel,
+	//and those stay small enough in here to step in 32 bit
+	const FixedEdgeFunction* pEdges[3]{ &triangle.raster.edge12, &triangle.raster.edge20, &triangle.raster.edge01 };
+	bool isEdgeCrossing[3]{};
+	for (int edgeIdx{}; edgeIdx < 3; ++edgeIdx)
+	{
+		const FixedEdgeFunction& edge{ *pEdges[edgeIdx] };
+		const int64_t corner0{ edge.Evaluate(minX, minY) };
+		const int64_t corner1{ edge.Evaluate(maxX - 1, minY) };
+		const int64_t corner2{ edge.Evaluate(minX, maxY - 1) };
+		const int64_t corner3{ edge.Evaluate(maxX - 1, maxY - 1) };
+
+		if (std::max(std::max(corner0, corner1), std::max(corner2, corner3)) < 0)
+			return;
+		isEdgeCrossing[edgeIdx] = std::min(std::min(corner0, corner1), std::min(corner2, corner3)) < 0;
+	}
 
-				int minX{ int(std::min(vertex0Pos.x, std::min(vertex1Pos.x, vertex2Pos.x))) };
-				int maxX{ int(std::max(vertex0Pos.x, std::max(vertex1Pos.x, vertex2Pos.x))) };
-				
-				int minY{ int(std::min(vertex0Pos.y, std::min(vertex1Pos.y, vertex2Pos.y))) };
-				int maxY{ int(std::max(vertex0Pos.y, std::max(vertex1Pos.y, vertex2Pos.y))) };
+	const int numBlocksX{ (m_Width + m_HiZBlockSize - 1) / m_HiZBlockSize };
+	const int firstBlockX{ minX / m_HiZBlockSize };
+	const int lastBlockX{ (maxX - 1) / m_HiZBlockSize };
+	bool depthChanged{ false };
 
-				int buffer{ 2 };
-				//clamp so it does not go out of bounds
-				minX = Clamp(minX-buffer, 0, m_Width);
-				maxX = Clamp(maxX+buffer, 0, m_Width);
+	SpanResult span{};
+	for (int blockY{ minY / m_HiZBlockSize }; blockY <= (maxY - 1) / m_HiZBlockSize; ++blockY)
+	{
+		//same test per 8x8 block, bit 0 is firstBlockX
+		uint32_t visibleBlocks{};
+		for (int blockX{ firstBlockX }; blockX <= lastBlockX; ++blockX)
+		{
+			if (triangle.minDepth <= m_pHiZBlockDepth[blockX + blockY * numBlocksX])
+				visibleBlocks |= 1u << (blockX - firstBlockX);
+		}
+		if (visibleBlocks == 0)
+			continue;
 
-				minY = Clamp(minY-buffer, 0, m_Height);
-				maxY = Clamp(maxY+buffer, 0, m_Height);
+		uint32_t touchedBlocks{};
+		const int rowStart{ std::max(minY, blockY * m_HiZBlockSize) };
+		const int rowEnd{ std::min(maxY, (blockY + 1) * m_HiZBlockSize) };
+		for (int py{ rowStart }; py < rowEnd; ++py)
+		{
+			//one kernel call per run of blocks next to each other that survived
+			uint32_t remainingBlocks{ visibleBlocks };
+			while (remainingBlocks != 0)
+			{
+				const int runFirst{ std::countr_zero(remainingBlocks) };
+				const int runLength{ std::countr_one(remainingBlocks >> runFirst) };
+				remainingBlocks &= ~(((1u << runLength) - 1) << runFirst);
 
-				//---------------
+				const int spanStart{ std::max(minX, (firstBlockX + runFirst) * m_HiZBlockSize) };
+				const int spanEnd{ std::min(maxX, (firstBlockX + runFirst + runLength) * m_HiZBlockSize) };
 
-				for (int px{ minX }; px < maxX; ++px)
+				//edges that do not cross the tile stay at 0, which always counts as inside
+				SpanEdges spanEdges{};
+				for (int edgeIdx{}; edgeIdx < 3; ++edgeIdx)
 				{
-					if (px < 0) continue;
-
-					for (int py{ minY }; py < maxY; ++py)
-					{
-						if (py < 0) continue;
-
-						const Vector3 pointP{ px + 0.5f, py + 0.5f,0.f };
-
-						const Vector3 signedAreaParallelogram12{ Vector3::Cross(edge21, pointP - vertex1Pos) };
-						const Vector3 signedAreaParallelogram20{ Vector3::Cross(edge02, pointP - vertex2Pos) };
-						const Vector3 signedAreaParallelogram01{ Vector3::Cross(edge10, pointP - vertex0Pos) };
-						const float triangleArea = signedAreaParallelogram12.z + signedAreaParallelogram20.z + signedAreaParallelogram01.z;
-
-						bool isInsideTriangle = true;
-						isInsideTriangle &= signedAreaParallelogram01.z >= 0.0f;
-						isInsideTriangle &= signedAreaParallelogram20.z >= 0.0f;
-						isInsideTriangle &= signedAreaParallelogram12.z >= 0.0f;
-
-						if (isInsideTriangle) {
-							// weights
-							const float weight0{ signedAreaParallelogram12.z / triangleArea };
-							const float weight1{ signedAreaParallelogram20.z / triangleArea };
-							const float weight2{ signedAreaParallelogram01.z / triangleArea };
-
-							// check to seeif the weight is correct bc this breaks 24/7 pls
-							assert((weight0 + weight1 + weight2) > 0.99f);
-							assert((weight0 + weight1 + weight2) < 1.01f);
-
-
-							// interpolated depth
-							float currentDepth = 1 / ((weight0 / vertex0Pos.w) + (weight1 / vertex1Pos.w) + (weight2 / vertex2Pos.w));
-
-							const int depthIndex{ px + (py * m_Width) };
-							
-
-							// Check the depth buffer
-							if (currentDepth > m_pDepthBufferPixels[depthIndex])
-								continue;
-
-							//look at what mode and make either color or go shade it bestie
-							ColorRGB barycentricColor{};
-							switch (m_CurrentRenderMode)
-							{
-								case dae::Renderer::RenderMode::FinalColor:
-								{
-									//SETUP FOR PIXELSHADING MKE ALL YOUR STUFF:--------------
-
-							//POS
-									float wInterpolated = currentDepth; //just for eadability
-									float zInterpolated = 1 / ((weight0 / vertex0Pos.z) + (weight1 / vertex1Pos.z) + (weight2 / vertex2Pos.z));
-
-									//UV
-									Vector2 uvInterpolated = { (
-										(vertex0.uv * weight0 / vertex0Pos.w) +
-										(vertex1.uv * weight1 / vertex1Pos.w) +
-										(vertex2.uv * weight2 / vertex2Pos.w)
-									) * currentDepth };
-
-									//COLOR
-									ColorRGB colorInterpolated = { (
-										(vertex0.color * weight0 / vertex0Pos.w) +
-										(vertex1.color * weight1 / vertex1Pos.w) +
-										(vertex2.color * weight2 / vertex2Pos.w)
-									) * currentDepth };
-
-									//NORMAL
-									Vector3 normalInterpolated = { (
-										(vertex0.normal * weight0 / vertex0Pos.w) +
-										(vertex1.normal * weight1 / vertex1Pos.w) +
-										(vertex2.normal * weight2 / vertex2Pos.w)
-									) * currentDepth };
-									normalInterpolated.Normalize(); //in slides it says you need to mak sure it is normalized pls do
-
-									//TANGENT
-									Vector3 tangentInterpolated = { (
-										(vertex0.tangent * weight0 / vertex0Pos.w) +
-										(vertex1.tangent * weight1 / vertex1Pos.w) +
-										(vertex2.tangent * weight2 / vertex2Pos.w)
-									) * currentDepth };
-									tangentInterpolated.Normalize();
-
-									//VIEWDIRECTION
-									Vector3 viewDirectionInterpolated = { (
-										(vertex0.viewDirection * weight0 / vertex0Pos.w) +
-										(vertex1.viewDirection * weight1 / vertex1Pos.w) +
-										(vertex2.viewDirection * weight2 / vertex2Pos.w)
-									) * currentDepth };
-									viewDirectionInterpolated.Normalize();
-
-									//--------------------------
-
-									//the pixel you are on right now to shade with all the interpolated calc you just did
-									Vertex_Out vertex_OutPixelshading{
-									Vector4{pointP.x,pointP.y,zInterpolated,wInterpolated},
-									colorInterpolated,
-									uvInterpolated,
-									normalInterpolated,tangentInterpolated,
-									viewDirectionInterpolated };
-
-
-
-
-									//barycentricColor = mp_Texture->Sample(uvInterpolated); old news we cool now
-									barycentricColor = PxelShading(vertex_OutPixelshading);
-									break;
-								}
-								case dae::Renderer::RenderMode::DepthBuffer:
-								{
-									//buffer
-									float min{ .985f };
-									float max{ 1.f };
-									float depthBuffer{ (currentDepth - min) * (max - min) };
-
-									barycentricColor = ColorRGB(depthBuffer, depthBuffer, depthBuffer);
-									break;
-								}
-							}
-
-							//ColorRGB barycentricColor = { m_Mesh.vertices_out[indxVector0].color * weightA + m_Mesh.vertices_out[indxVector1].color * weightB + m_Mesh.vertices_out[indxVector2].color * weightC };
-						
-							m_pDepthBufferPixels[depthIndex] = currentDepth;
-
-							//Update Color in Buffer
-							barycentricColor.MaxToOne();
-							m_pBackBufferPixels[depthIndex] = SDL_MapRGB(m_pBackBuffer->format,
-								static_cast<uint8_t>(barycentricColor.r * 255),
-								static_cast<uint8_t>(barycentricColor.g * 255),
-								static_cast<uint8_t>(barycentricColor.b * 255));
-						}
-					}
+					if (!isEdgeCrossing[edgeIdx])
+						continue;
+					spanEdges.start[edgeIdx] = int32_t(pEdges[edgeIdx]->Evaluate(spanStart, py));
+					spanEdges.step[edgeIdx] = int32_t(pEdges[edgeIdx]->a * SubPixelScale);
 				}
 
+				//the kernel does the inside test and the depth test for the whole span and already writes the depth
+				const int tiledSpanStart{ GetTiledPixelIdx(tile, spanStart, py) };
+				const uint32_t coverage{ m_pRasterSpan(triangle.raster, spanEdges, py, spanStart, spanEnd - spanStart, m_pDepthBufferPixels + tiledSpanStart, span) };
+				if (coverage == 0)
+					continue;
+
+				for (uint32_t remaining{ coverage }; remaining != 0; remaining &= remaining - 1)
+				{
+					const int spanIdx{ std::countr_zero(remaining) };
+					touchedBlocks |= 1u << ((spanStart + spanIdx) / m_HiZBlockSize - firstBlockX);
+
+					//deferred only remembers who is on top, shading happens once the tile is done
+					if (m_DeferredShadingEnabled)
+						m_pVisibilityBuffer[tiledSpanStart + spanIdx] = triangleIdx;
+				}
+
+				if (!m_DeferredShadingEnabled)
+				{
+					//texture modes picked once for the span instead of for every sample
+					WithMaterialSampler([&]<SampleMode sampleMode, AddressMode addressMode, bool isPowerOfTwo>()
+						{
+							ShadeSpan<sampleMode, addressMode, isPowerOfTwo>(triangle, py, spanStart, coverage, span);
+						});
+				}
 			}
 		}
 
-	//@END
-	//Update SDL Surface
-	SDL_UnlockSurface(m_pBackBuffer);
-	SDL_BlitSurface(m_pBackBuffer, 0, m_pFrontBuffer, 0);
-	SDL_UpdateWindowSurface(m_pWindow);
+		//blocks we wrote to can only have gotten closer, get their new farthest depth
+		while (touchedBlocks != 0)
+		{
+			const int blockX{ firstBlockX + std::countr_zero(touchedBlocks) };
+			touchedBlocks &= touchedBlocks - 1;
+			UpdateHiZBlock(tile, blockX, blockY);
+			depthChanged = true;
+		}
+	}
+
+	if (depthChanged)
+	{
+		UpdateHiZTile(tile);
+	}
+}
+
+void Renderer::UpdateHiZBlock(const Tile& tile, int blockX, int blockY)
+{
+	const int startX{ blockX * m_HiZBlockSize };
+	const int endX{ std::min(startX + m_HiZBlockSize, m_Width) };
+	const int startY{ blockY * m_HiZBlockSize };
+	const int endY{ std::min(startY + m_HiZBlockSize, m_Height) };
+
+	float maxDepth{ 0.f };
+	for (int py{ startY }; py < endY; ++py)
+	{
+		//blocks never cross a tile, so every row of the block is contiguous
+		const float* pDepthRow{ m_pDepthBufferPixels + GetTiledPixelIdx(tile, startX, py) };
+		for (int px{}; px < endX - startX; ++px)
+		{
+			maxDepth = std::max(maxDepth, pDepthRow[px]);
+		}
+	}
+
+	const int numBlocksX{ (m_Width + m_HiZBlockSize - 1) / m_HiZBlockSize };
+	m_pHiZBlockDepth[blockX + blockY * numBlocksX] = maxDepth;
 }
 
+void Renderer::UpdateHiZTile(Tile& tile)
+{
+	const int numBlocksX{ (m_Width + m_HiZBlockSize - 1) / m_HiZBlockSize };
+	const BoundingBox& tileBox{ tile.boundingBox };
+
+	float maxDepth{ 0.f };
+	for (int blockY{ tileBox.top / m_HiZBlockSize }; blockY <= (tileBox.bottom - 1) / m_HiZBlockSize; ++blockY)
+	{
+		for (int blockX{ tileBox.left / m_HiZBlockSize }; blockX <= (tileBox.right - 1) / m_HiZBlockSize; ++blockX)
+		{
+			maxDepth = std::max(maxDepth, m_pHiZBlockDepth[blockX + blockY * numBlocksX]);
+		}
+	}
+	tile.maxDepth = maxDepth;
+}
 
-ColorRGB Renderer::PxelShading(Vertex_Out& vec) 
+template<SampleMode sampleMode, AddressMode addressMode, bool isPowerOfTwo>
+ColorRGB Renderer::ShadeFragment(const TriangleSetup& triangle, const Vector2& pointP, float currentDepth)
+{
+	//look at what mode and make either color or go shade it bestie
+	ColorRGB barycentricColor{};
+	switch (m_CurrentRenderMode)
+	{
+		case dae::Renderer::RenderMode::FinalColor:
+		{
+			//SETUP FOR PIXELSHADING MKE ALL YOUR STUFF:--------------
+
+	//POS
+			float wInterpolated = currentDepth; //just for eadability
+			//the planes start at vertex 0
+			const float offsetX{ pointP.x - triangle.raster.originX };
+			const float offsetY{ pointP.y - triangle.raster.originY };
+			float zInterpolated = triangle.attributes.z.Evaluate(offsetX, offsetY);
+
+			//every plane gives attribute / w, times w (the depth) gives the perspective correct attribute
+			float values[AttributePlanes::NumValues]{};
+			for (int valueIdx{}; valueIdx < AttributePlanes::NumValues; ++valueIdx)
+			{
+				values[valueIdx] = triangle.attributes.values[valueIdx].Evaluate(offsetX, offsetY) * wInterpolated;
+			}
+
+			//UV
+			Vector2 uvInterpolated{ values[0], values[1] };
+
+			//uv changes over the screen straight from the planes: d(u) = w * (d(u / w) - u * d(1 / w))
+			const EdgeFunction& invW{ triangle.raster.invW };
+			const Vector2 uvDx{
+				wInterpolated * (triangle.attributes.values[0].a - uvInterpolated.x * invW.a),
+				wInterpolated * (triangle.attributes.values[1].a - uvInterpolated.y * invW.a) };
+			const Vector2 uvDy{
+				wInterpolated * (triangle.attributes.values[0].b - uvInterpolated.x * invW.b),
+				wInterpolated * (triangle.attributes.values[1].b - uvInterpolated.y * invW.b) };
+
+			//COLOR
+			ColorRGB colorInterpolated{ values[2], values[3], values[4] };
+
+			//NORMAL
+			Vector3 normalInterpolated{ values[5], values[6], values[7] };
+			normalInterpolated.Normalize(); //in slides it says you need to mak sure it is normalized pls do
+
+			//TANGENT
+			Vector3 tangentInterpolated{ values[8], values[9], values[10] };
+			tangentInterpolated.Normalize();
+
+			//VIEWDIRECTION
+			Vector3 viewDirectionInterpolated{ values[11], values[12], values[13] };
+			viewDirectionInterpolated.Normalize();
+
+			//--------------------------
+
+			//the pixel you are on right now to shade with all the interpolated calc you just did
+			Fragment vertex_OutPixelshading{
+			Vector4{pointP.x,pointP.y,zInterpolated,wInterpolated},
+			colorInterpolated,
+			uvInterpolated,
+			normalInterpolated,tangentInterpolated,
+			viewDirectionInterpolated,
+			uvDx, uvDy };
+
+
+
+
+			//barycentricColor = mp_Texture->Sample(uvInterpolated); old news we cool now
+			barycentricColor = PxelShading<sampleMode, addressMode, isPowerOfTwo>(vertex_OutPixelshading);
+			break;
+		}
+		case dae::Renderer::RenderMode::DepthBuffer:
+		{
+			//buffer
+			float min{ .985f };
+			float max{ 1.f };
+			float depthBuffer{ (currentDepth - min) * (max - min) };
+
+			barycentricColor = ColorRGB(depthBuffer, depthBuffer, depthBuffer);
+			break;
+		}
+	}
+
+	return barycentricColor;
+}
+
+
+template<SampleMode sampleMode, AddressMode addressMode, bool isPowerOfTwo>
+ColorRGB Renderer::PxelShading(Fragment& vec) 
 {
 	//things we got from the docu
 	const Vector3 lightDirection{ .577f, -.577f, .577f };
@@ -387,10 +1219,11 @@ ColorRGB Renderer::PxelShading(Vertex_Out& vec)
 	const float shininess{ 25.0f }; 
 
 	//all my uv's from my Textures for readability
-	const ColorRGB diffuseColorSample{ mp_Texture->Sample(vec.uv) };
-	const ColorRGB specularColorSample{ mp_Specular->Sample(vec.uv) };
-	const ColorRGB normalColorSample{ mp_Normal->Sample(vec.uv) };
-	const ColorRGB glossinessColorSample{ mp_Gloss->Sample(vec.uv) };
+	const ColorRGBA diffuseGlossSample{ mp_DiffuseGloss->SampleWith<sampleMode, addressMode, isPowerOfTwo>(vec.uv, vec.uvDx, vec.uvDy) };
+	const ColorRGBA normalSpecularSample{ mp_NormalSpecular->SampleWith<sampleMode, addressMode, isPowerOfTwo>(vec.uv, vec.uvDx, vec.uvDy) };
+	const ColorRGB diffuseColorSample{ diffuseGlossSample.rgb };
+	const ColorRGB specularColorSample{ normalSpecularSample.rgb.b, normalSpecularSample.rgb.b, normalSpecularSample.rgb.b };
+	const float glossiness{ diffuseGlossSample.a };
 
 	//tangent space want "Implement tangents":)
 
@@ -400,7 +1233,10 @@ ColorRGB Renderer::PxelShading(Vertex_Out& vec)
 	//normals:
 	Vector3 currentNormal{};
 	if (m_NormalsEnabled) {
-		const Vector3 tangentNormal{ normalColorSample.r * 2.0f - 1.0f, normalColorSample.g * 2.0f - 1.0f, normalColorSample.b * 2.0f - 1.0f };
+		//only xy is stored, the normal is unit length so z follows from them (tangent space normals never point inwards)
+		const float tangentNormalX{ normalSpecularSample.rgb.r * 2.0f - 1.0f };
+		const float tangentNormalY{ normalSpecularSample.rgb.g * 2.0f - 1.0f };
+		const Vector3 tangentNormal{ tangentNormalX, tangentNormalY, std::sqrt(std::max(0.f, 1.f - tangentNormalX * tangentNormalX - tangentNormalY * tangentNormalY)) };
 		currentNormal = { tangentSpaceAxis.TransformVector(tangentNormal.Normalized()).Normalized() };
 	}
 	else {
@@ -419,7 +1255,7 @@ ColorRGB Renderer::PxelShading(Vertex_Out& vec)
 	//get that other old phong that was actually fun
 	const Vector3 reflect{ lightDirection - (2.0f * Vector3::Dot(currentNormal, lightDirection) * currentNormal) };
 	const float RdotV{ std::max(0.0f, Vector3::Dot(reflect, -vec.viewDirection)) };
-	const ColorRGB phongSpecular{ specularColorSample * powf(RdotV, glossinessColorSample.r * shininess) };
+	const ColorRGB phongSpecular{ specularColorSample * powf(RdotV, glossiness * shininess) };
 	
 	switch (m_CurrentShadingMode)
 	{
@@ -464,6 +1300,45 @@ void dae::Renderer::ToggleNormals()
 	m_NormalsEnabled = !m_NormalsEnabled;
 }
 
+void dae::Renderer::ToggleDeferredShading()
+{
+	m_DeferredShadingEnabled = !m_DeferredShadingEnabled;
+}
+
+void dae::Renderer::ToggleVertexThreads()
+{
+	//0 means every core, doubling from 1 shows what each extra thread buys
+	const int numCores{ int(std::max(1u, std::thread::hardware_concurrency())) };
+	m_NumVertexThreads = m_NumVertexThreads == 0 ? 1 : m_NumVertexThreads * 2;
+	if (m_NumVertexThreads >= numCores)
+		m_NumVertexThreads = 0;
+
+	std::cout << "Vertex threads: " << (m_NumVertexThreads == 0 ? numCores : m_NumVertexThreads) << (m_NumVertexThreads == 0 ? " (every core)" : "") << std::endl;
+}
+
+void dae::Renderer::ToggleSampleMode()
+{
+	//all textures always share the mode, so the diffuse one knows where we are
+	SampleMode sampleMode{};
+	switch (mp_DiffuseGloss->GetSampleMode())
+	{
+	case SampleMode::Point:
+		sampleMode = SampleMode::Bilinear;
+		break;
+	case SampleMode::Bilinear:
+		sampleMode = SampleMode::Trilinear;
+		break;
+	case SampleMode::Trilinear:
+		sampleMode = SampleMode::Point;
+		break;
+	}
+
+	for (Texture* pTexture : { mp_DiffuseGloss, mp_NormalSpecular })
+	{
+		pTexture->SetSampleMode(sampleMode);
+	}
+}
+
 void dae::Renderer::ToggleShadingMode()
 {
 	//cycle session, just give the next one
@@ -5,13 +5,15 @@
 
 #include "Camera.h"
 #include "DataTypes.h"
+#include "RasterKernels.h"
+#include "Texture.h"
+#include "VertexKernels.h"
 
 struct SDL_Window;
 struct SDL_Surface;
 
 namespace dae
 {
-	class Texture;
 	struct Mesh;
 	struct Vertex;
 	class Timer;
@@ -27,6 +29,58 @@ namespace dae
 		int top;
 	};
 
+	//attribute / w is linear on the screen, so the pixel shader only has to evaluate a plane per value and multiply by w
+	struct AttributePlanes
+	{
+		//uv (2), color (3), normal (3), tangent (3), viewDirection (3)
+		static constexpr int NumValues{ 14 };
+		EdgeFunction values[NumValues];
+		EdgeFunction z; //z / w, is already linear so it does not get the w multiply
+	};
+
+	//one triangle after the vertex stage, ready to be binned and rasterized
+	struct TriangleSetup
+	{
+		AttributePlanes attributes;
+		RasterTriangle raster;
+		float minDepth; //closest the triangle gets, used to test it against the hi-z
+		BoundingBox boundingBox; //in pixels, right and bottom are exclusive (y goes down so top < bottom)
+	};
+
+	//interpolated attributes of one pixel, full precision (Vertex_Out is the packed per-vertex version)
+	struct Fragment
+	{
+		Vector4 position;
+		ColorRGB color;
+		Vector2 uv;
+		Vector3 normal;
+		Vector3 tangent;
+		Vector3 viewDirection;
+		Vector2 uvDx; //how much uv changes to the next pixel right and down, for the mip level
+		Vector2 uvDy;
+	};
+
+	//one vertex the way SetupTriangle needs it, SetupTriangles keeps recent ones around so shared vertices are only done once
+	struct SetupVertex
+	{
+		const Vertex_Out* pVertex;
+		int64_t fixedX; //snapped to the sub-pixel grid
+		int64_t fixedY;
+		float invW;
+		bool isValid; //false for positions that are not finite
+		bool isPacked; //values is only filled once a triangle using it survives culling
+		float values[AttributePlanes::NumValues];
+	};
+
+	//screen tile, owns its pixels so tiles can be rasterized at the same time without locks
+	struct Tile
+	{
+		BoundingBox boundingBox;
+		std::vector<uint32_t> triangleIndices; //indices in m_Triangles, in submission order
+		float maxDepth; //farthest depth in the tile, top level of the hi-z
+		int bufferOffset; //where the pixels of this tile start in the tiled depth and visibility buffers
+	};
+
 	struct HitResult
 	{
 		bool didHit;
@@ -57,10 +111,80 @@ namespace dae
 		void ToggleRotation() { m_RotationEnabled = !m_RotationEnabled; }
 		void ToggleNormals();
 		void ToggleShadingMode();
+		//point, bilinear or trilinear on every texture
+		void ToggleSampleMode();
+		void ToggleDeferredShading();
+		//every core, then 1, 2, 4, ... up to the core count and back
+		void ToggleVertexThreads();
 
-		ColorRGB PxelShading(Vertex_Out& vec);
+		//the texture modes are template arguments so the samples inline, see WithMaterialSampler
+		template<SampleMode sampleMode, AddressMode addressMode, bool isPowerOfTwo>
+		ColorRGB PxelShading(Fragment& vec);
 
 	private:
+		//the unit tests drive the stages one by one through this (Unit_Tests/RendererTests.cpp)
+		friend class RendererTest;
+
+		//only the buffers, tiles, kernels and camera: no window, textures or meshes, for the unit tests
+		Renderer(int width, int height);
+		//everything both constructors need once m_Width and m_Height are known
+		void Initialize();
+
+		//planes as dot(plane, (p, 1)) >= 0 is inside, in whatever space the matrix transforms from
+		static void ExtractFrustumPlanes(const Matrix& matrix, Vector4 planes[6]);
+		static bool IsMeshVisible(const Mesh& mesh, const Matrix& viewProjection, const Vector4 frustumPlanes[6]);
+		bool IsMeshletVisible(const Mesh& mesh, const Meshlet& meshlet, const Vector4 frustumPlanes[6]) const;
+		//coarsest lod whose error still stays under m_LodPixelError on screen when drawn with world, 0 is the full mesh
+		int SelectLod(const Mesh& mesh, const Matrix& world) const;
+
+		//a range of one mesh for the vertex kernels, so big meshes get spread over the threads too
+		struct VertexChunk
+		{
+			Mesh* pMesh;
+			size_t first;
+			size_t last;
+			bool isWorldDirty;
+		};
+		VertexTransformParams GetVertexTransformParams(const Matrix& viewProjection) const;
+		//culls the mesh and its meshlets and adds the out of date vertex ranges to chunks, false when the whole mesh is culled
+		bool GatherVertexChunks(Mesh& mesh, const Matrix& viewProjection, const Vector4 frustumPlanes[6], std::vector<VertexChunk>& chunks) const;
+		void TransformVertexChunks(const std::vector<VertexChunk>& chunks, const VertexTransformParams& params) const;
+		//vertex stage and triangle setup for every visible instance, they take turns using the buffers of the mesh (or its lods)
+		void SetupInstances(Mesh& mesh);
+
+		void SetupTriangles(const Mesh& mesh);
+		void SetupTriangle(const Vertex_Out& vertex0, const Vertex_Out& vertex1, const Vertex_Out& vertex2, CullMode cullMode);
+		void SetupTriangle(SetupVertex& vertex0, SetupVertex& vertex1, SetupVertex& vertex2, CullMode cullMode);
+		static void PrepareSetupVertex(const Vertex_Out& vertex, SetupVertex& setupVertex);
+		void ClipTriangle(const Vertex_Out& vertex0, const Vertex_Out& vertex1, const Vertex_Out& vertex2, CullMode cullMode);
+		//clips against near, far and the guard band (only the planes a vertex is outside of), polygon gets the screen space result
+		//and the number of vertices in it is returned, less than 3 means nothing is left
+		int ClipPolygon(const Vertex_Out& vertex0, const Vertex_Out& vertex1, const Vertex_Out& vertex2, Vertex_Out polygon[]) const;
+		Vertex_Out ToClipSpace(const Vertex_Out& vertex) const;
+		Vertex_Out ToScreenSpace(const Vertex_Out& vertex) const;
+		static Vertex_Out LerpVertex(const Vertex_Out& from, const Vertex_Out& to, float factor);
+		void BinTriangles();
+		void RenderTile(Tile& tile);
+		void RasterizeTriangle(uint32_t triangleIdx, Tile& tile);
+		void ShadeVisibilityBuffer(const Tile& tile);
+		//forward shading of the covered pixels of one span
+		template<SampleMode sampleMode, AddressMode addressMode, bool isPowerOfTwo>
+		void ShadeSpan(const TriangleSetup& triangle, int py, int spanStart, uint32_t coverage, const SpanResult& span);
+		void WritePixel(int pixelIdx, ColorRGB color);
+		void UpdateHiZBlock(const Tile& tile, int blockX, int blockY);
+		void UpdateHiZTile(Tile& tile);
+		//depth and visibility are tile by tile, row-major inside a tile, so a tile is one contiguous chunk
+		int GetTiledBufferSize() const { return ((m_Width + m_TileSize - 1) / m_TileSize) * ((m_Height + m_TileSize - 1) / m_TileSize) * m_TileSize * m_TileSize; }
+		int GetTiledPixelIdx(const Tile& tile, int px, int py) const { return tile.bufferOffset + (px - tile.boundingBox.left) + (py - tile.boundingBox.top) * m_TileSize; }
+		int GetNumHiZBlocks() const { return ((m_Width + m_HiZBlockSize - 1) / m_HiZBlockSize) * ((m_Height + m_HiZBlockSize - 1) / m_HiZBlockSize); }
+		static void PackAttributes(const Vertex_Out& vertex, float invW, float values[AttributePlanes::NumValues]);
+		template<SampleMode sampleMode, AddressMode addressMode, bool isPowerOfTwo>
+		ColorRGB ShadeFragment(const TriangleSetup& triangle, const Vector2& pointP, float currentDepth);
+		//calls function with the modes of the material textures as template arguments,
+		//once per tile or span so the pixels in there never branch or call indirectly to sample
+		template<typename Function>
+		void WithMaterialSampler(Function&& function) const;
+
 		enum class RenderMode
 		{
 			FinalColor,
@@ -84,6 +208,14 @@ namespace dae
 
 		float* m_pDepthBufferPixels{};
 
+		//hi-z: farthest depth of every 8x8 block of the depth buffer, the tiles keep the max of their blocks
+		const int m_HiZBlockSize{ 8 };
+		float* m_pHiZBlockDepth{};
+
+		//deferred: triangle in front for every pixel (index in m_Triangles), shaded after the tile is rasterized
+		const uint32_t m_NoTriangle{ UINT32_MAX };
+		uint32_t* m_pVisibilityBuffer{};
+
 		Camera m_Camera{};
 
 		int m_Width{};
@@ -92,17 +224,38 @@ namespace dae
 		std::vector<Mesh> m_MeshesWorld{};
 		//Mesh m_Mesh{};
 
+		//guard band in ndc units, triangles inside it skip clipping and just get clamped to the screen
+		const float m_GuardBand{ 4.f };
+		//every clip plane can add at most one vertex to the triangle
+		static constexpr int m_MaxClipVertices{ 3 + 6 };
+		//slots in the post-transform cache of SetupTriangles, direct mapped by vertex index
+		static constexpr uint32_t m_SetupCacheSize{ 64 };
+		//how many pixels a lod is allowed to be off from the full mesh
+		float m_LodPixelError{ 1.f };
+
+		const int m_TileSize{ MaxSpanLength };
+		RasterKernel m_RasterKernel{ RasterKernel::Scalar };
+		RasterSpanFunction m_pRasterSpan{ &RasterSpanScalar };
+		TransformToWorldFunction m_pTransformToWorld{ &TransformToWorldScalar };
+		ProjectVerticesFunction m_pProjectVertices{ &ProjectVerticesScalar };
+		PackVertexAttributesFunction m_pPackVertexAttributes{ &PackVertexAttributesScalar };
+		//vertex stage splits meshes in chunks of this many vertices and spreads them over m_NumVertexThreads
+		const size_t m_VertexChunkSize{ 4096 };
+		int m_NumVertexThreads{};
+		std::vector<TriangleSetup> m_Triangles{};
+		std::vector<Tile> m_Tiles{};
+
 		float m_AspectRatio{};
 
 		const int m_NumVertices{ 3 };
 
-		Texture* mp_Texture{};
-		Texture* mp_Normal{};
-		Texture* mp_Specular{};
-		Texture* mp_Gloss{};
+		//diffuse rgb with gloss in a, and normal xy with specular in b (normal z gets rebuilt when shading)
+		Texture* mp_DiffuseGloss{};
+		Texture* mp_NormalSpecular{};
 
 
 		bool m_NormalsEnabled{ true };
+		bool m_DeferredShadingEnabled{ true };
 
 		float m_CurrentMeshRotation{ 0.0f };
 		bool m_RotationEnabled{ true };
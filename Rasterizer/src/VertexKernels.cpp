@@ -0,0 +1,369 @@
+#include "VertexKernels.h"
+
+#include <cmath>
+#include <emmintrin.h>
+
+namespace dae
+{
+	void TransformToWorldScalar(const VertexStreams& streams, const Matrix& world, size_t first, size_t last, VertexStreams& worldStreams)
+	{
+		for (size_t vertexIdx{ first }; vertexIdx < last; ++vertexIdx)
+		{
+			const Vector3 position{ world.TransformPoint(streams.positionX[vertexIdx], streams.positionY[vertexIdx], streams.positionZ[vertexIdx]) };
+			//normals and tangents go to world space, not through the projection
+			const Vector3 normal{ world.TransformVector(streams.normalX[vertexIdx], streams.normalY[vertexIdx], streams.normalZ[vertexIdx]).Normalized() };
+			const Vector3 tangent{ world.TransformVector(streams.tangentX[vertexIdx], streams.tangentY[vertexIdx], streams.tangentZ[vertexIdx]).Normalized() };
+
+			worldStreams.positionX[vertexIdx] = position.x;
+			worldStreams.positionY[vertexIdx] = position.y;
+			worldStreams.positionZ[vertexIdx] = position.z;
+			worldStreams.normalX[vertexIdx] = normal.x;
+			worldStreams.normalY[vertexIdx] = normal.y;
+			worldStreams.normalZ[vertexIdx] = normal.z;
+			worldStreams.tangentX[vertexIdx] = tangent.x;
+			worldStreams.tangentY[vertexIdx] = tangent.y;
+			worldStreams.tangentZ[vertexIdx] = tangent.z;
+		}
+	}
+
+	void ProjectVerticesScalar(const VertexStreams& worldStreams, const VertexTransformParams& params, size_t first, size_t last, Vertex_Out* pVerticesOut)
+	{
+		for (size_t vertexIdx{ first }; vertexIdx < last; ++vertexIdx)
+		{
+			const Vector3 worldPosition{ worldStreams.positionX[vertexIdx], worldStreams.positionY[vertexIdx], worldStreams.positionZ[vertexIdx] };
+			Vector4 vec{ params.viewProjection.TransformPoint(worldPosition.x, worldPosition.y, worldPosition.z, 1.f) };
+
+			//which planes it is outside of, only near/far and the guard band need real clipping later
+			uint8_t clipFlags{};
+			if (vec.z < 0.f) clipFlags |= ClipNear;
+			if (vec.z > vec.w) clipFlags |= ClipFar;
+			if (vec.x < -vec.w) clipFlags |= ClipLeft;
+			if (vec.x > vec.w) clipFlags |= ClipRight;
+			if (vec.y < -vec.w) clipFlags |= ClipBottom;
+			if (vec.y > vec.w) clipFlags |= ClipTop;
+			if (std::abs(vec.x) > params.guardBand * vec.w || std::abs(vec.y) > params.guardBand * vec.w) clipFlags |= ClipGuardBand;
+
+			//vertices that still need clipping stay in clip space, setup projects them after clipping
+			if ((clipFlags & ClipNeeded) == 0)
+			{
+				vec.x /= vec.w;
+				vec.y /= vec.w;
+				vec.z /= vec.w;
+
+				vec.x = ((vec.x + 1) / 2) * params.width;
+				vec.y = ((1 - vec.y) / 2) * params.height;
+			}
+
+			Vertex_Out& vertexOut{ pVerticesOut[vertexIdx] };
+			vertexOut.position = vec;
+			vertexOut.SetViewDirection(worldPosition - params.cameraOrigin);
+			vertexOut.clipFlags = clipFlags;
+		}
+	}
+
+	namespace
+	{
+		//row r, column c of a matrix in every lane
+		__m128 Splat(const Matrix& matrix, int row, int column)
+		{
+			return _mm_set1_ps(matrix[row][column]);
+		}
+
+		//m[0][c] * x + m[1][c] * y + m[2][c] * z (+ m[3][c])
+		__m128 TransformColumn(const Matrix& matrix, int column, __m128 x, __m128 y, __m128 z, bool isPoint)
+		{
+			__m128 result{ _mm_add_ps(_mm_add_ps(_mm_mul_ps(Splat(matrix, 0, column), x), _mm_mul_ps(Splat(matrix, 1, column), y)), _mm_mul_ps(Splat(matrix, 2, column), z)) };
+			if (isPoint)
+				result = _mm_add_ps(result, Splat(matrix, 3, column));
+			return result;
+		}
+
+		//transforms a direction stream and writes it normalized
+		void TransformDirectionSSE(const Matrix& world, const float* pX, const float* pY, const float* pZ, float* pOutX, float* pOutY, float* pOutZ)
+		{
+			const __m128 x{ _mm_loadu_ps(pX) };
+			const __m128 y{ _mm_loadu_ps(pY) };
+			const __m128 z{ _mm_loadu_ps(pZ) };
+			const __m128 worldX{ TransformColumn(world, 0, x, y, z, false) };
+			const __m128 worldY{ TransformColumn(world, 1, x, y, z, false) };
+			const __m128 worldZ{ TransformColumn(world, 2, x, y, z, false) };
+			const __m128 length{ _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(worldX, worldX), _mm_mul_ps(worldY, worldY)), _mm_mul_ps(worldZ, worldZ))) };
+			_mm_storeu_ps(pOutX, _mm_div_ps(worldX, length));
+			_mm_storeu_ps(pOutY, _mm_div_ps(worldY, length));
+			_mm_storeu_ps(pOutZ, _mm_div_ps(worldZ, length));
+		}
+
+		//lround, the convert instruction would round halfway cases to even
+		__m128i RoundHalfAwaySSE(__m128 value)
+		{
+			const __m128i truncated{ _mm_cvttps_epi32(value) };
+			const __m128 fraction{ _mm_sub_ps(value, _mm_cvtepi32_ps(truncated)) };
+			const __m128i roundUp{ _mm_castps_si128(_mm_cmpge_ps(fraction, _mm_set1_ps(0.5f))) };
+			const __m128i roundDown{ _mm_castps_si128(_mm_cmple_ps(fraction, _mm_set1_ps(-0.5f))) };
+			//the masks are -1, so subtracting one goes up
+			return _mm_add_epi32(_mm_sub_epi32(truncated, roundUp), roundDown);
+		}
+
+		//PackUnitVector on 4 lanes, same bits
+		__m128i PackUnitVectorSSE(const float* pX, const float* pY, const float* pZ)
+		{
+			const __m128 zero{ _mm_setzero_ps() };
+			const __m128 one{ _mm_set1_ps(1.f) };
+			const __m128 signMask{ _mm_set1_ps(-0.f) };
+			const __m128 x{ _mm_loadu_ps(pX) };
+			const __m128 y{ _mm_loadu_ps(pY) };
+			const __m128 z{ _mm_loadu_ps(pZ) };
+
+			const __m128 lengthL1{ _mm_add_ps(_mm_add_ps(_mm_andnot_ps(signMask, x), _mm_andnot_ps(signMask, y)), _mm_andnot_ps(signMask, z)) };
+			const __m128 u{ _mm_div_ps(x, lengthL1) };
+			const __m128 v{ _mm_div_ps(y, lengthL1) };
+
+			//fold the bottom half over the top, the sign is 1 for 0 too (like signNotZero)
+			const __m128 signU{ _mm_or_ps(one, _mm_andnot_ps(_mm_cmpge_ps(u, zero), signMask)) };
+			const __m128 signV{ _mm_or_ps(one, _mm_andnot_ps(_mm_cmpge_ps(v, zero), signMask)) };
+			const __m128 foldedU{ _mm_mul_ps(_mm_sub_ps(one, _mm_andnot_ps(signMask, v)), signU) };
+			const __m128 foldedV{ _mm_mul_ps(_mm_sub_ps(one, _mm_andnot_ps(signMask, u)), signV) };
+			const __m128 isBottom{ _mm_cmplt_ps(z, zero) };
+			const __m128 octahedronU{ _mm_or_ps(_mm_and_ps(isBottom, foldedU), _mm_andnot_ps(isBottom, u)) };
+			const __m128 octahedronV{ _mm_or_ps(_mm_and_ps(isBottom, foldedV), _mm_andnot_ps(isBottom, v)) };
+
+			//2 snorm16, a zero vector gives 0
+			const __m128 minusOne{ _mm_set1_ps(-1.f) };
+			const __m128 snormScale{ _mm_set1_ps(32767.f) };
+			const __m128i snormU{ RoundHalfAwaySSE(_mm_mul_ps(_mm_min_ps(_mm_max_ps(octahedronU, minusOne), one), snormScale)) };
+			const __m128i snormV{ RoundHalfAwaySSE(_mm_mul_ps(_mm_min_ps(_mm_max_ps(octahedronV, minusOne), one), snormScale)) };
+			const __m128i packed{ _mm_or_si128(_mm_and_si128(snormU, _mm_set1_epi32(0xffff)), _mm_slli_epi32(snormV, 16)) };
+			return _mm_and_si128(packed, _mm_castps_si128(_mm_cmpgt_ps(lengthL1, zero)));
+		}
+	}
+
+	void TransformToWorldSSE(const VertexStreams& streams, const Matrix& world, size_t first, size_t last, VertexStreams& worldStreams)
+	{
+		size_t vertexIdx{ first };
+		for (; vertexIdx + 4 <= last; vertexIdx += 4)
+		{
+			const __m128 x{ _mm_loadu_ps(streams.positionX.data() + vertexIdx) };
+			const __m128 y{ _mm_loadu_ps(streams.positionY.data() + vertexIdx) };
+			const __m128 z{ _mm_loadu_ps(streams.positionZ.data() + vertexIdx) };
+			_mm_storeu_ps(worldStreams.positionX.data() + vertexIdx, TransformColumn(world, 0, x, y, z, true));
+			_mm_storeu_ps(worldStreams.positionY.data() + vertexIdx, TransformColumn(world, 1, x, y, z, true));
+			_mm_storeu_ps(worldStreams.positionZ.data() + vertexIdx, TransformColumn(world, 2, x, y, z, true));
+
+			//normals and tangents go to world space, not through the projection
+			TransformDirectionSSE(world, streams.normalX.data() + vertexIdx, streams.normalY.data() + vertexIdx, streams.normalZ.data() + vertexIdx,
+				worldStreams.normalX.data() + vertexIdx, worldStreams.normalY.data() + vertexIdx, worldStreams.normalZ.data() + vertexIdx);
+			TransformDirectionSSE(world, streams.tangentX.data() + vertexIdx, streams.tangentY.data() + vertexIdx, streams.tangentZ.data() + vertexIdx,
+				worldStreams.tangentX.data() + vertexIdx, worldStreams.tangentY.data() + vertexIdx, worldStreams.tangentZ.data() + vertexIdx);
+		}
+
+		//the rest does not fill a register
+		TransformToWorldScalar(streams, world, vertexIdx, last, worldStreams);
+	}
+
+	void ProjectVerticesSSE(const VertexStreams& worldStreams, const VertexTransformParams& params, size_t first, size_t last, Vertex_Out* pVerticesOut)
+	{
+		const Matrix& viewProjection{ params.viewProjection };
+
+		const __m128 zero{ _mm_setzero_ps() };
+		const __m128 one{ _mm_set1_ps(1.f) };
+		const __m128 half{ _mm_set1_ps(0.5f) };
+		const __m128 signMask{ _mm_set1_ps(-0.f) };
+		const __m128 width{ _mm_set1_ps(params.width) };
+		const __m128 height{ _mm_set1_ps(params.height) };
+		const __m128 guardBand{ _mm_set1_ps(params.guardBand) };
+
+		VertexBatch batch{};
+		size_t vertexIdx{ first };
+		for (; vertexIdx + 4 <= last; vertexIdx += 4)
+		{
+			const __m128 x{ _mm_loadu_ps(worldStreams.positionX.data() + vertexIdx) };
+			const __m128 y{ _mm_loadu_ps(worldStreams.positionY.data() + vertexIdx) };
+			const __m128 z{ _mm_loadu_ps(worldStreams.positionZ.data() + vertexIdx) };
+
+			__m128 clipX{ TransformColumn(viewProjection, 0, x, y, z, true) };
+			__m128 clipY{ TransformColumn(viewProjection, 1, x, y, z, true) };
+			__m128 clipZ{ TransformColumn(viewProjection, 2, x, y, z, true) };
+			const __m128 clipW{ TransformColumn(viewProjection, 3, x, y, z, true) };
+
+			//one movemask per flag, same order as the ClipFlag bits
+			const __m128 guardW{ _mm_mul_ps(guardBand, clipW) };
+			const __m128 outsideNear{ _mm_cmplt_ps(clipZ, zero) };
+			const __m128 outsideFar{ _mm_cmpgt_ps(clipZ, clipW) };
+			const __m128 outsideGuardBand{ _mm_or_ps(_mm_cmpgt_ps(_mm_andnot_ps(signMask, clipX), guardW), _mm_cmpgt_ps(_mm_andnot_ps(signMask, clipY), guardW)) };
+			const int clipMasks[7]{
+				_mm_movemask_ps(outsideNear),
+				_mm_movemask_ps(outsideFar),
+				_mm_movemask_ps(_mm_cmplt_ps(clipX, _mm_xor_ps(clipW, signMask))),
+				_mm_movemask_ps(_mm_cmpgt_ps(clipX, clipW)),
+				_mm_movemask_ps(_mm_cmplt_ps(clipY, _mm_xor_ps(clipW, signMask))),
+				_mm_movemask_ps(_mm_cmpgt_ps(clipY, clipW)),
+				_mm_movemask_ps(outsideGuardBand) };
+			UnpackClipFlags(clipMasks, 4, batch.clipFlags);
+
+			//project everything and keep the clip space values for the lanes that still need clipping
+			const __m128 keepClip{ _mm_or_ps(outsideNear, _mm_or_ps(outsideFar, outsideGuardBand)) };
+			const __m128 screenX{ _mm_mul_ps(_mm_mul_ps(_mm_add_ps(_mm_div_ps(clipX, clipW), one), half), width) };
+			const __m128 screenY{ _mm_mul_ps(_mm_mul_ps(_mm_sub_ps(one, _mm_div_ps(clipY, clipW)), half), height) };
+			const __m128 screenZ{ _mm_div_ps(clipZ, clipW) };
+			clipX = _mm_or_ps(_mm_and_ps(keepClip, clipX), _mm_andnot_ps(keepClip, screenX));
+			clipY = _mm_or_ps(_mm_and_ps(keepClip, clipY), _mm_andnot_ps(keepClip, screenY));
+			clipZ = _mm_or_ps(_mm_and_ps(keepClip, clipZ), _mm_andnot_ps(keepClip, screenZ));
+
+			_mm_store_ps(batch.positionX, clipX);
+			_mm_store_ps(batch.positionY, clipY);
+			_mm_store_ps(batch.positionZ, clipZ);
+			_mm_store_ps(batch.positionW, clipW);
+
+			//sse2 has no half conversion, so that part is per lane
+			alignas(16) float viewDirection[3][4];
+			_mm_store_ps(viewDirection[0], _mm_sub_ps(x, _mm_set1_ps(params.cameraOrigin.x)));
+			_mm_store_ps(viewDirection[1], _mm_sub_ps(y, _mm_set1_ps(params.cameraOrigin.y)));
+			_mm_store_ps(viewDirection[2], _mm_sub_ps(z, _mm_set1_ps(params.cameraOrigin.z)));
+			for (int lane{}; lane < 4; ++lane)
+			{
+				batch.viewDirectionX[lane] = FloatToHalf(viewDirection[0][lane]);
+				batch.viewDirectionY[lane] = FloatToHalf(viewDirection[1][lane]);
+				batch.viewDirectionZ[lane] = FloatToHalf(viewDirection[2][lane]);
+			}
+
+			WriteVertexBatch(batch, vertexIdx, 4, pVerticesOut);
+		}
+
+		//the rest does not fill a register
+		ProjectVerticesScalar(worldStreams, params, vertexIdx, last, pVerticesOut);
+	}
+
+	void PackVertexAttributesScalar(const VertexStreams& streams, const VertexStreams& worldStreams, size_t first, size_t last, Vertex_Out* pVerticesOut)
+	{
+		for (size_t vertexIdx{ first }; vertexIdx < last; ++vertexIdx)
+		{
+			Vertex_Out& vertexOut{ pVerticesOut[vertexIdx] };
+			vertexOut.SetNormal(Vector3{ worldStreams.normalX[vertexIdx], worldStreams.normalY[vertexIdx], worldStreams.normalZ[vertexIdx] });
+			vertexOut.SetTangent(Vector3{ worldStreams.tangentX[vertexIdx], worldStreams.tangentY[vertexIdx], worldStreams.tangentZ[vertexIdx] });
+			vertexOut.uv = streams.uv[vertexIdx];
+			vertexOut.SetPackedColor(streams.color[vertexIdx]);
+		}
+	}
+
+	void PackVertexAttributesSSE(const VertexStreams& streams, const VertexStreams& worldStreams, size_t first, size_t last, Vertex_Out* pVerticesOut)
+	{
+		size_t vertexIdx{ first };
+		for (; vertexIdx + 4 <= last; vertexIdx += 4)
+		{
+			alignas(16) uint32_t normals[4];
+			alignas(16) uint32_t tangents[4];
+			_mm_store_si128(reinterpret_cast<__m128i*>(normals), PackUnitVectorSSE(worldStreams.normalX.data() + vertexIdx, worldStreams.normalY.data() + vertexIdx, worldStreams.normalZ.data() + vertexIdx));
+			_mm_store_si128(reinterpret_cast<__m128i*>(tangents), PackUnitVectorSSE(worldStreams.tangentX.data() + vertexIdx, worldStreams.tangentY.data() + vertexIdx, worldStreams.tangentZ.data() + vertexIdx));
+
+			//Vertex_Out is not split in streams, so the stores are per lane
+			for (int lane{}; lane < 4; ++lane)
+			{
+				Vertex_Out& vertexOut{ pVerticesOut[vertexIdx + lane] };
+				vertexOut.normal = normals[lane];
+				vertexOut.tangent = tangents[lane];
+				vertexOut.uv = streams.uv[vertexIdx + lane];
+				vertexOut.SetPackedColor(streams.color[vertexIdx + lane]);
+			}
+		}
+
+		//the rest does not fill a register
+		PackVertexAttributesScalar(streams, worldStreams, vertexIdx, last, pVerticesOut);
+	}
+
+	TransformToWorldFunction GetTransformToWorldFunction(RasterKernel kernel)
+	{
+		switch (kernel)
+		{
+		case RasterKernel::AVX2:
+			return &TransformToWorldAVX2;
+		case RasterKernel::SSE:
+			return &TransformToWorldSSE;
+		default:
+			return &TransformToWorldScalar;
+		}
+	}
+
+	ProjectVerticesFunction GetProjectVerticesFunction(RasterKernel kernel)
+	{
+		switch (kernel)
+		{
+		case RasterKernel::AVX2:
+			return &ProjectVerticesAVX2;
+		case RasterKernel::SSE:
+			return &ProjectVerticesSSE;
+		default:
+			return &ProjectVerticesScalar;
+		}
+	}
+
+	PackVertexAttributesFunction GetPackVertexAttributesFunction(RasterKernel kernel)
+	{
+		switch (kernel)
+		{
+		case RasterKernel::AVX2:
+			return &PackVertexAttributesAVX2;
+		case RasterKernel::SSE:
+			return &PackVertexAttributesSSE;
+		default:
+			return &PackVertexAttributesScalar;
+		}
+	}
+
+	void BuildVertexStreams(const std::vector<Vertex>& vertices, VertexStreams& streams)
+	{
+		streams = VertexStreams{};
+		for (const Vertex& vertex : vertices)
+		{
+			streams.positionX.push_back(vertex.position.x);
+			streams.positionY.push_back(vertex.position.y);
+			streams.positionZ.push_back(vertex.position.z);
+			streams.normalX.push_back(vertex.normal.x);
+			streams.normalY.push_back(vertex.normal.y);
+			streams.normalZ.push_back(vertex.normal.z);
+			streams.tangentX.push_back(vertex.tangent.x);
+			streams.tangentY.push_back(vertex.tangent.y);
+			streams.tangentZ.push_back(vertex.tangent.z);
+			streams.uv.push_back(PackHalf2(vertex.uv));
+			streams.color.push_back(PackColor(vertex.color));
+		}
+	}
+
+	void ResizeWorldStreams(size_t size, VertexStreams& worldStreams)
+	{
+		worldStreams.positionX.resize(size);
+		worldStreams.positionY.resize(size);
+		worldStreams.positionZ.resize(size);
+		worldStreams.normalX.resize(size);
+		worldStreams.normalY.resize(size);
+		worldStreams.normalZ.resize(size);
+		worldStreams.tangentX.resize(size);
+		worldStreams.tangentY.resize(size);
+		worldStreams.tangentZ.resize(size);
+	}
+
+	void UnpackClipFlags(const int pMasks[7], int count, uint8_t* pClipFlags)
+	{
+		for (int lane{}; lane < count; ++lane)
+		{
+			uint8_t clipFlags{};
+			for (int flagBit{}; flagBit < 7; ++flagBit)
+			{
+				clipFlags |= uint8_t(((pMasks[flagBit] >> lane) & 1) << flagBit);
+			}
+			pClipFlags[lane] = clipFlags;
+		}
+	}
+
+	void WriteVertexBatch(const VertexBatch& batch, size_t first, int count, Vertex_Out* pVerticesOut)
+	{
+		for (int lane{}; lane < count; ++lane)
+		{
+			Vertex_Out& vertexOut{ pVerticesOut[first + lane] };
+			vertexOut.position = Vector4{ batch.positionX[lane], batch.positionY[lane], batch.positionZ[lane], batch.positionW[lane] };
+			vertexOut.viewDirection[0] = batch.viewDirectionX[lane];
+			vertexOut.viewDirection[1] = batch.viewDirectionY[lane];
+			vertexOut.viewDirection[2] = batch.viewDirectionZ[lane];
+			vertexOut.clipFlags = batch.clipFlags[lane];
+		}
+	}
+}
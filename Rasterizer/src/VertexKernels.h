@@ -0,0 +1,77 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "DataTypes.h"
+#include "RasterKernels.h"
+
+namespace dae
+{
+	//the most vertices one simd iteration handles (avx2 width)
+	constexpr int MaxVertexBatchSize{ 8 };
+
+	//everything the projection kernels need that is the same for every vertex of a mesh
+	struct VertexTransformParams
+	{
+		Matrix viewProjection;
+		Vector3 cameraOrigin;
+		float width;
+		float height;
+		float guardBand;
+	};
+
+	//output of one simd iteration of the projection, one array per component, WriteVertexBatch turns it into Vertex_Out
+	struct alignas(32) VertexBatch
+	{
+		float positionX[MaxVertexBatchSize];
+		float positionY[MaxVertexBatchSize];
+		float positionZ[MaxVertexBatchSize];
+		float positionW[MaxVertexBatchSize];
+		uint16_t viewDirectionX[MaxVertexBatchSize]; //already halves, the way Vertex_Out stores them
+		uint16_t viewDirectionY[MaxVertexBatchSize];
+		uint16_t viewDirectionZ[MaxVertexBatchSize];
+		uint8_t clipFlags[MaxVertexBatchSize];
+	};
+
+	//World part, only depends on the world matrix so it gets cached until that changes.
+	//Writes world position and normalized world normal/tangent of [first, last) to worldStreams (sized by the caller, no uv/color).
+	using TransformToWorldFunction = void(*)(const VertexStreams& streams, const Matrix& world, size_t first, size_t last, VertexStreams& worldStreams);
+
+	//Camera part, reads the world streams and writes position, viewDirection and clipFlags of pVerticesOut[first, last).
+	//Position ends up in screen space, or stays in clip space when the vertex needs clipping (see ClipNeeded).
+	//The rest of Vertex_Out does not depend on the camera, PackVertexAttributes fills it after the world part.
+	using ProjectVerticesFunction = void(*)(const VertexStreams& worldStreams, const VertexTransformParams& params, size_t first, size_t last, Vertex_Out* pVerticesOut);
+
+	//Packs the world normal/tangent (octahedral) and the uv/color streams into pVerticesOut[first, last), only needed when the world part ran.
+	//Every version gives the same bits as Vertex_Out::SetNormal/SetTangent.
+	using PackVertexAttributesFunction = void(*)(const VertexStreams& streams, const VertexStreams& worldStreams, size_t first, size_t last, Vertex_Out* pVerticesOut);
+
+	void TransformToWorldScalar(const VertexStreams& streams, const Matrix& world, size_t first, size_t last, VertexStreams& worldStreams);
+	void TransformToWorldSSE(const VertexStreams& streams, const Matrix& world, size_t first, size_t last, VertexStreams& worldStreams);
+	void TransformToWorldAVX2(const VertexStreams& streams, const Matrix& world, size_t first, size_t last, VertexStreams& worldStreams);
+
+	void ProjectVerticesScalar(const VertexStreams& worldStreams, const VertexTransformParams& params, size_t first, size_t last, Vertex_Out* pVerticesOut);
+	void ProjectVerticesSSE(const VertexStreams& worldStreams, const VertexTransformParams& params, size_t first, size_t last, Vertex_Out* pVerticesOut);
+	void ProjectVerticesAVX2(const VertexStreams& worldStreams, const VertexTransformParams& params, size_t first, size_t last, Vertex_Out* pVerticesOut);
+
+	void PackVertexAttributesScalar(const VertexStreams& streams, const VertexStreams& worldStreams, size_t first, size_t last, Vertex_Out* pVerticesOut);
+	void PackVertexAttributesSSE(const VertexStreams& streams, const VertexStreams& worldStreams, size_t first, size_t last, Vertex_Out* pVerticesOut);
+	void PackVertexAttributesAVX2(const VertexStreams& streams, const VertexStreams& worldStreams, size_t first, size_t last, Vertex_Out* pVerticesOut);
+
+	//same instruction sets as the raster kernels, so one cpuid check picks both
+	TransformToWorldFunction GetTransformToWorldFunction(RasterKernel kernel);
+	ProjectVerticesFunction GetProjectVerticesFunction(RasterKernel kernel);
+	PackVertexAttributesFunction GetPackVertexAttributesFunction(RasterKernel kernel);
+
+	//splits the Vertex array into the streams
+	void BuildVertexStreams(const std::vector<Vertex>& vertices, VertexStreams& streams);
+	//sizes the position/normal/tangent streams for the world kernels
+	void ResizeWorldStreams(size_t size, VertexStreams& worldStreams);
+
+	//clip flags of the lanes, pMasks[flag bit] has bit lane set when that lane is outside
+	void UnpackClipFlags(const int pMasks[7], int count, uint8_t* pClipFlags);
+
+	//copies the batch to pVerticesOut[first, first + count), leaves the camera independent attributes alone
+	void WriteVertexBatch(const VertexBatch& batch, size_t first, int count, Vertex_Out* pVerticesOut);
+}
@@ -0,0 +1,192 @@
+//this file is built with /arch:AVX2, only call into it after GetBestRasterKernel said the cpu can do it
+#include "VertexKernels.h"
+
+#include <immintrin.h>
+
+namespace dae
+{
+	namespace
+	{
+		//row r, column c of a matrix in every lane
+		__m256 Splat(const Matrix& matrix, int row, int column)
+		{
+			return _mm256_set1_ps(matrix[row][column]);
+		}
+
+		//m[0][c] * x + m[1][c] * y + m[2][c] * z (+ m[3][c])
+		__m256 TransformColumn(const Matrix& matrix, int column, __m256 x, __m256 y, __m256 z, bool isPoint)
+		{
+			const __m256 start{ isPoint ? Splat(matrix, 3, column) : _mm256_setzero_ps() };
+			return _mm256_fmadd_ps(Splat(matrix, 0, column), x, _mm256_fmadd_ps(Splat(matrix, 1, column), y, _mm256_fmadd_ps(Splat(matrix, 2, column), z, start)));
+		}
+
+		//transforms a direction stream and writes it normalized
+		void TransformDirectionAVX2(const Matrix& world, const float* pX, const float* pY, const float* pZ, float* pOutX, float* pOutY, float* pOutZ)
+		{
+			const __m256 x{ _mm256_loadu_ps(pX) };
+			const __m256 y{ _mm256_loadu_ps(pY) };
+			const __m256 z{ _mm256_loadu_ps(pZ) };
+			const __m256 worldX{ TransformColumn(world, 0, x, y, z, false) };
+			const __m256 worldY{ TransformColumn(world, 1, x, y, z, false) };
+			const __m256 worldZ{ TransformColumn(world, 2, x, y, z, false) };
+			const __m256 length{ _mm256_sqrt_ps(_mm256_fmadd_ps(worldX, worldX, _mm256_fmadd_ps(worldY, worldY, _mm256_mul_ps(worldZ, worldZ)))) };
+			_mm256_storeu_ps(pOutX, _mm256_div_ps(worldX, length));
+			_mm256_storeu_ps(pOutY, _mm256_div_ps(worldY, length));
+			_mm256_storeu_ps(pOutZ, _mm256_div_ps(worldZ, length));
+		}
+
+		//lround, the convert instruction would round halfway cases to even
+		__m256i RoundHalfAwayAVX2(__m256 value)
+		{
+			const __m256i truncated{ _mm256_cvttps_epi32(value) };
+			const __m256 fraction{ _mm256_sub_ps(value, _mm256_cvtepi32_ps(truncated)) };
+			const __m256i roundUp{ _mm256_castps_si256(_mm256_cmp_ps(fraction, _mm256_set1_ps(0.5f), _CMP_GE_OQ)) };
+			const __m256i roundDown{ _mm256_castps_si256(_mm256_cmp_ps(fraction, _mm256_set1_ps(-0.5f), _CMP_LE_OQ)) };
+			//the masks are -1, so subtracting one goes up
+			return _mm256_add_epi32(_mm256_sub_epi32(truncated, roundUp), roundDown);
+		}
+
+		//PackUnitVector on 8 lanes, same bits
+		__m256i PackUnitVectorAVX2(const float* pX, const float* pY, const float* pZ)
+		{
+			const __m256 zero{ _mm256_setzero_ps() };
+			const __m256 one{ _mm256_set1_ps(1.f) };
+			const __m256 signMask{ _mm256_set1_ps(-0.f) };
+			const __m256 x{ _mm256_loadu_ps(pX) };
+			const __m256 y{ _mm256_loadu_ps(pY) };
+			const __m256 z{ _mm256_loadu_ps(pZ) };
+
+			const __m256 lengthL1{ _mm256_add_ps(_mm256_add_ps(_mm256_andnot_ps(signMask, x), _mm256_andnot_ps(signMask, y)), _mm256_andnot_ps(signMask, z)) };
+			const __m256 u{ _mm256_div_ps(x, lengthL1) };
+			const __m256 v{ _mm256_div_ps(y, lengthL1) };
+
+			//fold the bottom half over the top, the sign is 1 for 0 too (like signNotZero)
+			const __m256 signU{ _mm256_or_ps(one, _mm256_andnot_ps(_mm256_cmp_ps(u, zero, _CMP_GE_OQ), signMask)) };
+			const __m256 signV{ _mm256_or_ps(one, _mm256_andnot_ps(_mm256_cmp_ps(v, zero, _CMP_GE_OQ), signMask)) };
+			const __m256 foldedU{ _mm256_mul_ps(_mm256_sub_ps(one, _mm256_andnot_ps(signMask, v)), signU) };
+			const __m256 foldedV{ _mm256_mul_ps(_mm256_sub_ps(one, _mm256_andnot_ps(signMask, u)), signV) };
+			const __m256 isBottom{ _mm256_cmp_ps(z, zero, _CMP_LT_OQ) };
+			const __m256 octahedronU{ _mm256_blendv_ps(u, foldedU, isBottom) };
+			const __m256 octahedronV{ _mm256_blendv_ps(v, foldedV, isBottom) };
+
+			//2 snorm16, a zero vector gives 0
+			const __m256 minusOne{ _mm256_set1_ps(-1.f) };
+			const __m256 snormScale{ _mm256_set1_ps(32767.f) };
+			const __m256i snormU{ RoundHalfAwayAVX2(_mm256_mul_ps(_mm256_min_ps(_mm256_max_ps(octahedronU, minusOne), one), snormScale)) };
+			const __m256i snormV{ RoundHalfAwayAVX2(_mm256_mul_ps(_mm256_min_ps(_mm256_max_ps(octahedronV, minusOne), one), snormScale)) };
+			const __m256i packed{ _mm256_or_si256(_mm256_and_si256(snormU, _mm256_set1_epi32(0xffff)), _mm256_slli_epi32(snormV, 16)) };
+			return _mm256_and_si256(packed, _mm256_castps_si256(_mm256_cmp_ps(lengthL1, zero, _CMP_GT_OQ)));
+		}
+	}
+
+	void TransformToWorldAVX2(const VertexStreams& streams, const Matrix& world, size_t first, size_t last, VertexStreams& worldStreams)
+	{
+		size_t vertexIdx{ first };
+		for (; vertexIdx + 8 <= last; vertexIdx += 8)
+		{
+			const __m256 x{ _mm256_loadu_ps(streams.positionX.data() + vertexIdx) };
+			const __m256 y{ _mm256_loadu_ps(streams.positionY.data() + vertexIdx) };
+			const __m256 z{ _mm256_loadu_ps(streams.positionZ.data() + vertexIdx) };
+			_mm256_storeu_ps(worldStreams.positionX.data() + vertexIdx, TransformColumn(world, 0, x, y, z, true));
+			_mm256_storeu_ps(worldStreams.positionY.data() + vertexIdx, TransformColumn(world, 1, x, y, z, true));
+			_mm256_storeu_ps(worldStreams.positionZ.data() + vertexIdx, TransformColumn(world, 2, x, y, z, true));
+
+			//normals and tangents go to world space, not through the projection
+			TransformDirectionAVX2(world, streams.normalX.data() + vertexIdx, streams.normalY.data() + vertexIdx, streams.normalZ.data() + vertexIdx,
+				worldStreams.normalX.data() + vertexIdx, worldStreams.normalY.data() + vertexIdx, worldStreams.normalZ.data() + vertexIdx);
+			TransformDirectionAVX2(world, streams.tangentX.data() + vertexIdx, streams.tangentY.data() + vertexIdx, streams.tangentZ.data() + vertexIdx,
+				worldStreams.tangentX.data() + vertexIdx, worldStreams.tangentY.data() + vertexIdx, worldStreams.tangentZ.data() + vertexIdx);
+		}
+
+		//the rest does not fill a register
+		TransformToWorldScalar(streams, world, vertexIdx, last, worldStreams);
+	}
+
+	void ProjectVerticesAVX2(const VertexStreams& worldStreams, const VertexTransformParams& params, size_t first, size_t last, Vertex_Out* pVerticesOut)
+	{
+		const Matrix& viewProjection{ params.viewProjection };
+
+		const __m256 zero{ _mm256_setzero_ps() };
+		const __m256 one{ _mm256_set1_ps(1.f) };
+		const __m256 half{ _mm256_set1_ps(0.5f) };
+		const __m256 signMask{ _mm256_set1_ps(-0.f) };
+		const __m256 width{ _mm256_set1_ps(params.width) };
+		const __m256 height{ _mm256_set1_ps(params.height) };
+		const __m256 guardBand{ _mm256_set1_ps(params.guardBand) };
+
+		VertexBatch batch{};
+		size_t vertexIdx{ first };
+		for (; vertexIdx + 8 <= last; vertexIdx += 8)
+		{
+			const __m256 x{ _mm256_loadu_ps(worldStreams.positionX.data() + vertexIdx) };
+			const __m256 y{ _mm256_loadu_ps(worldStreams.positionY.data() + vertexIdx) };
+			const __m256 z{ _mm256_loadu_ps(worldStreams.positionZ.data() + vertexIdx) };
+
+			const __m256 clipX{ TransformColumn(viewProjection, 0, x, y, z, true) };
+			const __m256 clipY{ TransformColumn(viewProjection, 1, x, y, z, true) };
+			const __m256 clipZ{ TransformColumn(viewProjection, 2, x, y, z, true) };
+			const __m256 clipW{ TransformColumn(viewProjection, 3, x, y, z, true) };
+
+			//one movemask per flag, same order as the ClipFlag bits
+			const __m256 minusW{ _mm256_xor_ps(clipW, signMask) };
+			const __m256 guardW{ _mm256_mul_ps(guardBand, clipW) };
+			const __m256 outsideNear{ _mm256_cmp_ps(clipZ, zero, _CMP_LT_OQ) };
+			const __m256 outsideFar{ _mm256_cmp_ps(clipZ, clipW, _CMP_GT_OQ) };
+			const __m256 outsideGuardBand{ _mm256_or_ps(_mm256_cmp_ps(_mm256_andnot_ps(signMask, clipX), guardW, _CMP_GT_OQ), _mm256_cmp_ps(_mm256_andnot_ps(signMask, clipY), guardW, _CMP_GT_OQ)) };
+			const int clipMasks[7]{
+				_mm256_movemask_ps(outsideNear),
+				_mm256_movemask_ps(outsideFar),
+				_mm256_movemask_ps(_mm256_cmp_ps(clipX, minusW, _CMP_LT_OQ)),
+				_mm256_movemask_ps(_mm256_cmp_ps(clipX, clipW, _CMP_GT_OQ)),
+				_mm256_movemask_ps(_mm256_cmp_ps(clipY, minusW, _CMP_LT_OQ)),
+				_mm256_movemask_ps(_mm256_cmp_ps(clipY, clipW, _CMP_GT_OQ)),
+				_mm256_movemask_ps(outsideGuardBand) };
+			UnpackClipFlags(clipMasks, 8, batch.clipFlags);
+
+			//project everything and keep the clip space values for the lanes that still need clipping
+			const __m256 keepClip{ _mm256_or_ps(outsideNear, _mm256_or_ps(outsideFar, outsideGuardBand)) };
+			const __m256 screenX{ _mm256_mul_ps(_mm256_mul_ps(_mm256_add_ps(_mm256_div_ps(clipX, clipW), one), half), width) };
+			const __m256 screenY{ _mm256_mul_ps(_mm256_mul_ps(_mm256_sub_ps(one, _mm256_div_ps(clipY, clipW)), half), height) };
+			const __m256 screenZ{ _mm256_div_ps(clipZ, clipW) };
+			_mm256_store_ps(batch.positionX, _mm256_blendv_ps(screenX, clipX, keepClip));
+			_mm256_store_ps(batch.positionY, _mm256_blendv_ps(screenY, clipY, keepClip));
+			_mm256_store_ps(batch.positionZ, _mm256_blendv_ps(screenZ, clipZ, keepClip));
+			_mm256_store_ps(batch.positionW, clipW);
+
+			//f16c does all 8 halves at once
+			_mm_store_si128(reinterpret_cast<__m128i*>(batch.viewDirectionX), _mm256_cvtps_ph(_mm256_sub_ps(x, _mm256_set1_ps(params.cameraOrigin.x)), _MM_FROUND_TO_NEAREST_INT));
+			_mm_store_si128(reinterpret_cast<__m128i*>(batch.viewDirectionY), _mm256_cvtps_ph(_mm256_sub_ps(y, _mm256_set1_ps(params.cameraOrigin.y)), _MM_FROUND_TO_NEAREST_INT));
+			_mm_store_si128(reinterpret_cast<__m128i*>(batch.viewDirectionZ), _mm256_cvtps_ph(_mm256_sub_ps(z, _mm256_set1_ps(params.cameraOrigin.z)), _MM_FROUND_TO_NEAREST_INT));
+
+			WriteVertexBatch(batch, vertexIdx, 8, pVerticesOut);
+		}
+
+		//the rest does not fill a register
+		ProjectVerticesScalar(worldStreams, params, vertexIdx, last, pVerticesOut);
+	}
+
+	void PackVertexAttributesAVX2(const VertexStreams& streams, const VertexStreams& worldStreams, size_t first, size_t last, Vertex_Out* pVerticesOut)
+	{
+		size_t vertexIdx{ first };
+		for (; vertexIdx + 8 <= last; vertexIdx += 8)
+		{
+			alignas(32) uint32_t normals[8];
+			alignas(32) uint32_t tangents[8];
+			_mm256_store_si256(reinterpret_cast<__m256i*>(normals), PackUnitVectorAVX2(worldStreams.normalX.data() + vertexIdx, worldStreams.normalY.data() + vertexIdx, worldStreams.normalZ.data() + vertexIdx));
+			_mm256_store_si256(reinterpret_cast<__m256i*>(tangents), PackUnitVectorAVX2(worldStreams.tangentX.data() + vertexIdx, worldStreams.tangentY.data() + vertexIdx, worldStreams.tangentZ.data() + vertexIdx));
+
+			//Vertex_Out is not split in streams, so the stores are per lane
+			for (int lane{}; lane < 8; ++lane)
+			{
+				Vertex_Out& vertexOut{ pVerticesOut[vertexIdx + lane] };
+				vertexOut.normal = normals[lane];
+				vertexOut.tangent = tangents[lane];
+				vertexOut.uv = streams.uv[vertexIdx + lane];
+				vertexOut.SetPackedColor(streams.color[vertexIdx + lane]);
+			}
+		}
+
+		//the rest does not fill a register
+		PackVertexAttributesScalar(streams, worldStreams, vertexIdx, last, pVerticesOut);
+	}
+}
@@ -71,7 +71,10 @@ int main(int argc, char* args[])
 				/*) Toggle Depth Buffer(F4)
 					- (Rendering)Toggle Rotation(Rotate / Idle) (F5)
 					- (Rendering)Toggle Normal Mapping(On / Off) (F6)
-					- (Rendering)Cycle Shading Mode(F7)*/
+					- (Rendering)Cycle Shading Mode(F7)
+					- (Rendering)Toggle Deferred Shading(On / Off) (F8)
+					- (Rendering)Cycle Texture Filtering(Point / Bilinear / Trilinear) (F9)
+					- (Rendering)Cycle Vertex Threads(All / 1 / 2 / 4 / ...) (F10)*/
 
 				if (e.key.keysym.scancode == SDL_SCANCODE_F4)
 					pRenderer->ToggleRenderMode();
@@ -81,6 +84,12 @@ int main(int argc, char* args[])
 					pRenderer->ToggleNormals();
 				if (e.key.keysym.scancode == SDL_SCANCODE_F7)
 					pRenderer->ToggleShadingMode();
+				if (e.key.keysym.scancode == SDL_SCANCODE_F8)
+					pRenderer->ToggleDeferredShading();
+				if (e.key.keysym.scancode == SDL_SCANCODE_F9)
+					pRenderer->ToggleSampleMode();
+				if (e.key.keysym.scancode == SDL_SCANCODE_F10)
+					pRenderer->ToggleVertexThreads();
 				break;
 			}
 		}
@@ -0,0 +1,266 @@
+#include "gtest/gtest.h"
+#include "Maths.h"
+#include "DataTypes.h"
+#include "Camera.h"
+#include "RasterKernels.h"
+#include "VertexKernels.h"
+#include "TestKernels.h"
+#include <random>
+#include <vector>
+
+
+//the simd kernels of the rasterizer project against their scalar versions
+namespace dae
+{
+	using namespace TestKernels;
+
+	namespace
+	{
+		//far enough out that some of the scattered vertices are past the far plane (which ends up at about 1000)
+		constexpr float ScatterRange{ 1500.f };
+
+		//vertices all around a camera near the origin: in view, behind it, past the far plane and outside the guard band
+		std::vector<Vertex> MakeScatteredVertices(size_t numVertices, uint32_t seed = 1234)
+		{
+			std::mt19937 random{ seed };
+			std::uniform_real_distribution<float> position{ -ScatterRange, ScatterRange };
+			std::uniform_real_distribution<float> unit{ -1.f, 1.f };
+			std::uniform_real_distribution<float> uv{ -2.f, 3.f };
+
+			std::vector<Vertex> vertices(numVertices);
+			for (Vertex& vertex : vertices) {
+				vertex.position = Vector3{ position(random), position(random), position(random) };
+				vertex.normal = Vector3{ unit(random), unit(random), unit(random) };
+				vertex.tangent = Vector3{ unit(random), unit(random), unit(random) };
+				vertex.uv = Vector2{ uv(random), uv(random) };
+				vertex.color = ColorRGB{ (unit(random) + 1.f) / 2.f, (unit(random) + 1.f) / 2.f, (unit(random) + 1.f) / 2.f };
+			}
+			return vertices;
+		}
+
+		//the kernels add the products up in another order (and the avx2 one uses fma), so the floats are only close
+		void ExpectClose(float value, float expected, float maxError, size_t vertexIdx, const char* what)
+		{
+			EXPECT_NEAR(value, expected, maxError) << what << " of vertex " << vertexIdx;
+		}
+
+		//a few ulp of the biggest coordinates, still well below a sub-pixel step for the ones that end up in screen space
+		constexpr float MaxPositionError{ ScatterRange * 1e-5f };
+		constexpr float MaxDirectionError{ 1e-5f };
+
+		//random triangle with sub-pixel vertices in a size x size pixel area, set up the way triangle setup does it
+		RasterTriangle MakeRandomRasterTriangle(std::mt19937& random, int size)
+		{
+			std::uniform_int_distribution<int64_t> position{ 0, int64_t(size) * SubPixelScale };
+			int64_t fixedX[3]{}, fixedY[3]{};
+			for (int vertexIdx{}; vertexIdx < 3; ++vertexIdx) {
+				fixedX[vertexIdx] = position(random);
+				fixedY[vertexIdx] = position(random);
+			}
+			//inside is E >= 0, so the vertices have to go clockwise on screen
+			const int64_t area{ (fixedX[1] - fixedX[0]) * (fixedY[2] - fixedY[0]) - (fixedY[1] - fixedY[0]) * (fixedX[2] - fixedX[0]) };
+			if (area < 0) {
+				std::swap(fixedX[1], fixedX[2]);
+				std::swap(fixedY[1], fixedY[2]);
+			}
+
+			//1/w stays well above 0 over the whole area
+			std::uniform_real_distribution<float> slope{ -0.004f, 0.004f };
+			std::uniform_real_distribution<float> start{ 0.7f, 1.f };
+			return RasterTriangle{
+				FixedEdgeFunction::FromEdge(fixedX[1], fixedY[1], fixedX[2], fixedY[2]),
+				FixedEdgeFunction::FromEdge(fixedX[2], fixedY[2], fixedX[0], fixedY[0]),
+				FixedEdgeFunction::FromEdge(fixedX[0], fixedY[0], fixedX[1], fixedY[1]),
+				EdgeFunction{ slope(random), slope(random), start(random) },
+				float(fixedX[0]) / SubPixelScale,
+				float(fixedY[0]) / SubPixelScale };
+		}
+
+		//the edge values of the span starting at pixel (x, y), like RasterizeTriangle fills them in
+		SpanEdges GetSpanEdges(const RasterTriangle& triangle, int x, int y)
+		{
+			const FixedEdgeFunction* pEdges[3]{ &triangle.edge12, &triangle.edge20, &triangle.edge01 };
+			SpanEdges spanEdges{};
+			for (int edgeIdx{}; edgeIdx < 3; ++edgeIdx) {
+				spanEdges.start[edgeIdx] = int32_t(pEdges[edgeIdx]->Evaluate(x, y));
+				spanEdges.step[edgeIdx] = int32_t(pEdges[edgeIdx]->a * SubPixelScale);
+			}
+			return spanEdges;
+		}
+
+		//not a multiple of 4 or 8, so every kernel runs its tail
+		constexpr size_t NumTestVertices{ 1003 };
+		//a chunk that starts and ends off the simd width, the way the renderer splits big meshes
+		constexpr size_t ChunkFirst{ 3 };
+		constexpr size_t ChunkLast{ NumTestVertices - 2 };
+	}
+
+	//--- vertex kernels ---
+
+	TEST(VertexKernels, TransformToWorldMatchesScalar) {
+		VertexStreams streams{};
+		BuildVertexStreams(MakeScatteredVertices(NumTestVertices), streams);
+		const Matrix world{ Matrix::CreateScale(1.5f, 0.5f, 2.f) * Matrix::CreateRotation(0.3f, 1.1f, -0.7f) * Matrix::CreateTranslation(4.f, -2.f, 10.f) };
+
+		VertexStreams expected{};
+		ResizeWorldStreams(NumTestVertices, expected);
+		TransformToWorldScalar(streams, world, 0, NumTestVertices, expected);
+
+		for (RasterKernel kernel : GetSupportedKernels()) {
+			SCOPED_TRACE(GetRasterKernelName(kernel));
+			VertexStreams worldStreams{};
+			ResizeWorldStreams(NumTestVertices, worldStreams);
+			GetTransformToWorldFunction(kernel)(streams, world, ChunkFirst, ChunkLast, worldStreams);
+
+			for (size_t vertexIdx{}; vertexIdx < NumTestVertices; ++vertexIdx) {
+				if (vertexIdx < ChunkFirst || vertexIdx >= ChunkLast) {
+					//outside the chunk, nothing may be written
+					EXPECT_EQ(worldStreams.positionX[vertexIdx], 0.f) << "vertex " << vertexIdx;
+					EXPECT_EQ(worldStreams.normalX[vertexIdx], 0.f) << "vertex " << vertexIdx;
+					EXPECT_EQ(worldStreams.tangentX[vertexIdx], 0.f) << "vertex " << vertexIdx;
+					continue;
+				}
+				ExpectClose(worldStreams.positionX[vertexIdx], expected.positionX[vertexIdx], MaxPositionError, vertexIdx, "position x");
+				ExpectClose(worldStreams.positionY[vertexIdx], expected.positionY[vertexIdx], MaxPositionError, vertexIdx, "position y");
+				ExpectClose(worldStreams.positionZ[vertexIdx], expected.positionZ[vertexIdx], MaxPositionError, vertexIdx, "position z");
+				ExpectClose(worldStreams.normalX[vertexIdx], expected.normalX[vertexIdx], MaxDirectionError, vertexIdx, "normal x");
+				ExpectClose(worldStreams.normalY[vertexIdx], expected.normalY[vertexIdx], MaxDirectionError, vertexIdx, "normal y");
+				ExpectClose(worldStreams.normalZ[vertexIdx], expected.normalZ[vertexIdx], MaxDirectionError, vertexIdx, "normal z");
+				ExpectClose(worldStreams.tangentX[vertexIdx], expected.tangentX[vertexIdx], MaxDirectionError, vertexIdx, "tangent x");
+				ExpectClose(worldStreams.tangentY[vertexIdx], expected.tangentY[vertexIdx], MaxDirectionError, vertexIdx, "tangent y");
+				ExpectClose(worldStreams.tangentZ[vertexIdx], expected.tangentZ[vertexIdx], MaxDirectionError, vertexIdx, "tangent z");
+			}
+		}
+	}
+
+	TEST(VertexKernels, ProjectVerticesMatchesScalar) {
+		//same world positions for every kernel, so only the projection is compared
+		VertexStreams worldStreams{};
+		BuildVertexStreams(MakeScatteredVertices(NumTestVertices), worldStreams);
+
+		Camera camera{};
+		camera.Initialize(60.f, { 1.f, 2.f, -3.f }, 16.f / 9.f);
+		camera.UpdateMatrices();
+		const VertexTransformParams params{ camera.viewMatrix * camera.projectionMatrix, camera.origin, 640.f, 360.f, 4.f };
+
+		std::vector<Vertex_Out> expected(NumTestVertices);
+		ProjectVerticesScalar(worldStreams, params, 0, NumTestVertices, expected.data());
+
+		//the scattered vertices have to hit every case, otherwise the flags are not really tested
+		uint8_t seenFlags{};
+		int numInside{};
+		for (const Vertex_Out& vertex : expected) {
+			seenFlags |= vertex.clipFlags;
+			numInside += vertex.clipFlags == 0;
+		}
+		ASSERT_EQ(seenFlags, ClipNear | ClipFar | ClipLeft | ClipRight | ClipBottom | ClipTop | ClipGuardBand);
+		ASSERT_GT(numInside, 0);
+
+		for (RasterKernel kernel : GetSupportedKernels()) {
+			SCOPED_TRACE(GetRasterKernelName(kernel));
+			std::vector<Vertex_Out> vertices(NumTestVertices);
+			GetProjectVerticesFunction(kernel)(worldStreams, params, ChunkFirst, ChunkLast, vertices.data());
+
+			for (size_t vertexIdx{}; vertexIdx < NumTestVertices; ++vertexIdx) {
+				const Vertex_Out& vertex{ vertices[vertexIdx] };
+				if (vertexIdx < ChunkFirst || vertexIdx >= ChunkLast) {
+					EXPECT_EQ(vertex.position, Vector4{}) << "vertex " << vertexIdx;
+					EXPECT_EQ(vertex.clipFlags, 0) << "vertex " << vertexIdx;
+					continue;
+				}
+				const Vertex_Out& expectedVertex{ expected[vertexIdx] };
+				//the flags pick between clip and screen space, so they have to be exact
+				ASSERT_EQ(vertex.clipFlags, expectedVertex.clipFlags) << "vertex " << vertexIdx;
+				ExpectClose(vertex.position.x, expectedVertex.position.x, MaxPositionError, vertexIdx, "position x");
+				ExpectClose(vertex.position.y, expectedVertex.position.y, MaxPositionError, vertexIdx, "position y");
+				ExpectClose(vertex.position.z, expectedVertex.position.z, MaxPositionError, vertexIdx, "position z");
+				ExpectClose(vertex.position.w, expectedVertex.position.w, MaxPositionError, vertexIdx, "position w");
+				for (int component{}; component < 3; ++component) {
+					EXPECT_EQ(vertex.viewDirection[component], expectedVertex.viewDirection[component]) << "view direction of vertex " << vertexIdx;
+				}
+			}
+		}
+	}
+
+	TEST(VertexKernels, PackVertexAttributesMatchesScalar) {
+		const std::vector<Vertex> scattered{ MakeScatteredVertices(NumTestVertices) };
+		VertexStreams streams{};
+		BuildVertexStreams(scattered, streams);
+		VertexStreams worldStreams{};
+		ResizeWorldStreams(NumTestVertices, worldStreams);
+		TransformToWorldScalar(streams, Matrix::CreateRotation(0.3f, 1.1f, -0.7f), 0, NumTestVertices, worldStreams);
+
+		std::vector<Vertex_Out> expected(NumTestVertices);
+		PackVertexAttributesScalar(streams, worldStreams, 0, NumTestVertices, expected.data());
+
+		for (RasterKernel kernel : GetSupportedKernels()) {
+			SCOPED_TRACE(GetRasterKernelName(kernel));
+			std::vector<Vertex_Out> vertices(NumTestVertices);
+			GetPackVertexAttributesFunction(kernel)(streams, worldStreams, ChunkFirst, ChunkLast, vertices.data());
+
+			for (size_t vertexIdx{}; vertexIdx < NumTestVertices; ++vertexIdx) {
+				const Vertex_Out& vertex{ vertices[vertexIdx] };
+				const Vertex_Out& expectedVertex{ vertexIdx < ChunkFirst || vertexIdx >= ChunkLast ? Vertex_Out{} : expected[vertexIdx] };
+				//packed bits, no tolerance
+				EXPECT_EQ(vertex.normal, expectedVertex.normal) << "vertex " << vertexIdx;
+				EXPECT_EQ(vertex.tangent, expectedVertex.tangent) << "vertex " << vertexIdx;
+				EXPECT_EQ(vertex.uv, expectedVertex.uv) << "vertex " << vertexIdx;
+				EXPECT_EQ(vertex.color, expectedVertex.color) << "vertex " << vertexIdx;
+				EXPECT_EQ(vertex.flags, expectedVertex.flags) << "vertex " << vertexIdx;
+			}
+		}
+	}
+
+	//--- raster kernels ---
+
+	TEST(RasterKernels, SpansMatchScalar) {
+		constexpr int areaSize{ 64 };
+		std::mt19937 random{ 1234 };
+		std::uniform_real_distribution<float> oldDepth{ 1.f, 5.f };
+		const std::vector<RasterKernel> kernels{ GetSupportedKernels() };
+
+		for (int triangleIdx{}; triangleIdx < 10; ++triangleIdx) {
+			const RasterTriangle triangle{ MakeRandomRasterTriangle(random, areaSize) };
+
+			for (int y{}; y < areaSize; ++y) {
+				//the depth buffer around the span as well, pixels next to it belong to another tile and must not change
+				std::vector<float> startDepth(areaSize);
+				for (float& depth : startDepth) {
+					depth = oldDepth(random);
+				}
+
+				//every span length, starting anywhere in the row, so the simd kernels run full registers and tails
+				for (int x{}; x < areaSize; x += 3) {
+					for (int count{ 1 }; count <= MaxSpanLength && x + count <= areaSize; ++count) {
+						const SpanEdges spanEdges{ GetSpanEdges(triangle, x, y) };
+						std::vector<float> expectedDepth{ startDepth };
+						SpanResult expectedResult{};
+						const uint32_t expectedMask{ RasterSpanScalar(triangle, spanEdges, y, x, count, expectedDepth.data() + x, expectedResult) };
+
+						//the reference itself: only pixels with every edge >= 0 get drawn
+						for (int i{}; i < count; ++i) {
+							const bool isInside{ triangle.edge12.Evaluate(x + i, y) >= 0 && triangle.edge20.Evaluate(x + i, y) >= 0 && triangle.edge01.Evaluate(x + i, y) >= 0 };
+							if (!isInside)
+								ASSERT_EQ((expectedMask >> i) & 1, 0u) << "pixel " << x + i << ", " << y;
+						}
+						ASSERT_EQ(uint64_t(expectedMask) >> count, 0u);
+
+						for (RasterKernel kernel : kernels) {
+							std::vector<float> depthRow{ startDepth };
+							SpanResult result{};
+							const uint32_t mask{ GetRasterSpanFunction(kernel)(triangle, spanEdges, y, x, count, depthRow.data() + x, result) };
+
+							ASSERT_EQ(mask, expectedMask) << GetRasterKernelName(kernel) << " span " << x << ", " << y << " of " << count;
+							//bit for bit, the depth test of the next triangle depends on it
+							ASSERT_EQ(depthRow, expectedDepth) << GetRasterKernelName(kernel) << " span " << x << ", " << y << " of " << count;
+							for (int i{}; i < count; ++i) {
+								if ((mask >> i) & 1)
+									ASSERT_EQ(result.depth[i], expectedResult.depth[i]) << GetRasterKernelName(kernel) << " pixel " << x + i << ", " << y;
+							}
+						}
+					}
+				}
+			}
+		}
+	}
+}
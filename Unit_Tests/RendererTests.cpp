@@ -0,0 +1,530 @@
+#include "gtest/gtest.h"
+#include "Maths.h"
+#include "DataTypes.h"
+#include "Renderer.h"
+#include "TestKernels.h"
+#include "TestMeshes.h"
+#include "Utils.h"
+#include <algorithm>
+#include <random>
+#include <vector>
+
+
+//the stages of the renderer one at a time, on a renderer without a window or scene
+namespace dae
+{
+	using namespace TestKernels;
+
+	namespace
+	{
+		//half precision uv at the vertices, plus the snapping to 1/16th of a pixel (as a part of the uv change per pixel)
+		constexpr float MaxUVError{ 0.001f };
+		constexpr float MaxPixelStepError{ 0.1f };
+
+		Vertex MakeVertex(const Vector3& position, const Vector2& uv)
+		{
+			Vertex vertex{};
+			vertex.position = position;
+			vertex.uv = uv;
+			vertex.normal = -Vector3::UnitZ;
+			vertex.tangent = Vector3::UnitX;
+			return vertex;
+		}
+
+		//uv the world triangle has where the ray through the pixel center hits it, what the clipped pieces have to reproduce
+		Vector2 GetExpectedUV(const Camera& camera, const std::vector<Vertex>& triangle, int width, int height, int px, int py)
+		{
+			const Matrix invViewProjection{ Matrix::Inverse(camera.viewMatrix * camera.projectionMatrix) };
+			const float ndcX{ (px + 0.5f) / width * 2.f - 1.f };
+			const float ndcY{ 1.f - (py + 0.5f) / height * 2.f };
+			const Vector4 pointOnRay{ invViewProjection.TransformPoint(ndcX, ndcY, 0.5f, 1.f) };
+			const Vector3 direction{ Vector3{ pointOnRay.x, pointOnRay.y, pointOnRay.z } / pointOnRay.w - camera.origin };
+
+			const Vector3& position0{ triangle[0].position };
+			const Vector3 edge1{ triangle[1].position - position0 };
+			const Vector3 edge2{ triangle[2].position - position0 };
+			const Vector3 normal{ Vector3::Cross(edge1, edge2) };
+			const Vector3 hit{ camera.origin + direction * (Vector3::Dot(position0 - camera.origin, normal) / Vector3::Dot(direction, normal)) };
+
+			//barycentric weights of the hit point
+			const float doubleArea{ normal.SqrMagnitude() };
+			const float weight1{ Vector3::Dot(Vector3::Cross(hit - position0, edge2), normal) / doubleArea };
+			const float weight2{ Vector3::Dot(Vector3::Cross(edge1, hit - position0), normal) / doubleArea };
+			return triangle[0].uv * (1.f - weight1 - weight2) + triangle[1].uv * weight1 + triangle[2].uv * weight2;
+		}
+	}
+
+	//friend of Renderer, the tests only get at its stages through the helpers in here
+	class RendererTest : public ::testing::Test
+	{
+	protected:
+		//not a multiple of the tile or hi-z block size, so the last row and column of both are partial
+		static constexpr int Width{ 200 };
+		static constexpr int Height{ 120 };
+
+		Renderer m_Renderer{ Width, Height };
+
+		std::vector<TriangleSetup>& GetTriangles() { return m_Renderer.m_Triangles; }
+
+		void SetRasterKernel(RasterKernel kernel) { m_Renderer.m_pRasterSpan = GetRasterSpanFunction(kernel); }
+
+		//camera at origin looking down +z
+		void LookFrom(const Vector3& origin)
+		{
+			m_Renderer.m_Camera.Initialize(60.f, origin, float(Width) / Height);
+			m_Renderer.m_Camera.UpdateMatrices();
+		}
+
+		//triangle list mesh through the vertex kernels of the renderer, without the mesh culling, so vertices_out has the real clip flags
+		Mesh TransformTriangles(const std::vector<Vertex>& vertices)
+		{
+			Mesh mesh{};
+			mesh.vertices = vertices;
+			for (uint32_t index{}; index < vertices.size(); ++index) {
+				mesh.indices.push_back(index);
+			}
+			mesh.primitiveTopology = PrimitiveTopology::TriangleList;
+			mesh.cullMode = CullMode::None;
+
+			const size_t numVertices{ vertices.size() };
+			BuildVertexStreams(mesh.vertices, mesh.vertexStreams);
+			ResizeWorldStreams(numVertices, mesh.worldStreams);
+			mesh.vertices_out.resize(numVertices);
+			m_Renderer.m_pTransformToWorld(mesh.vertexStreams, Matrix::CreateTranslation(0.f, 0.f, 0.f), 0, numVertices, mesh.worldStreams);
+			m_Renderer.m_pPackVertexAttributes(mesh.vertexStreams, mesh.worldStreams, 0, numVertices, mesh.vertices_out.data());
+			const Camera& camera{ m_Renderer.m_Camera };
+			m_Renderer.m_pProjectVertices(mesh.worldStreams, m_Renderer.GetVertexTransformParams(camera.viewMatrix * camera.projectionMatrix), 0, numVertices, mesh.vertices_out.data());
+			return mesh;
+		}
+
+		int ClipPolygon(const Vertex_Out& vertex0, const Vertex_Out& vertex1, const Vertex_Out& vertex2, std::vector<Vertex_Out>& polygon)
+		{
+			polygon.resize(Renderer::m_MaxClipVertices);
+			const int numVertices{ m_Renderer.ClipPolygon(vertex0, vertex1, vertex2, polygon.data()) };
+			polygon.resize(std::max(numVertices, 0));
+			return numVertices;
+		}
+
+		void SetupTriangles(const Mesh& mesh) { m_Renderer.SetupTriangles(mesh); }
+
+		float GetGuardBand() const { return m_Renderer.m_GuardBand; }
+
+		void SetupInstances(Mesh& mesh) { m_Renderer.SetupInstances(mesh); }
+		int SelectLod(const Mesh& mesh, const Matrix& world) const { return m_Renderer.SelectLod(mesh, world); }
+
+		//triangles already in screen space (no clipping needed), straight into triangle setup
+		void SetupScreenTriangles(const std::vector<Vector2>& positions, const std::vector<uint32_t>& indices, CullMode cullMode = CullMode::None)
+		{
+			Mesh mesh{};
+			mesh.primitiveTopology = PrimitiveTopology::TriangleList;
+			mesh.cullMode = cullMode;
+			mesh.indices = indices;
+			for (const Vector2& position : positions) {
+				Vertex_Out vertex{};
+				vertex.position = Vector4{ position.x, position.y, 0.5f, 1.f };
+				mesh.vertices_out.push_back(vertex);
+			}
+			m_Renderer.SetupTriangles(mesh);
+		}
+
+		//depth, hi-z and visibility back to empty, what Render and RenderTile do before drawing
+		void ClearBuffers()
+		{
+			std::fill_n(m_Renderer.m_pDepthBufferPixels, m_Renderer.GetTiledBufferSize(), FLT_MAX);
+			std::fill_n(m_Renderer.m_pHiZBlockDepth, m_Renderer.GetNumHiZBlocks(), FLT_MAX);
+			std::fill_n(m_Renderer.m_pVisibilityBuffer, m_Renderer.GetTiledBufferSize(), m_Renderer.m_NoTriangle);
+			for (Tile& tile : m_Renderer.m_Tiles) {
+				tile.maxDepth = FLT_MAX;
+			}
+		}
+
+		Tile& GetTile(int px, int py)
+		{
+			const int numTilesX{ (Width + m_Renderer.m_TileSize - 1) / m_Renderer.m_TileSize };
+			return m_Renderer.m_Tiles[px / m_Renderer.m_TileSize + (py / m_Renderer.m_TileSize) * numTilesX];
+		}
+
+		float GetDepth(int px, int py)
+		{
+			return m_Renderer.m_pDepthBufferPixels[m_Renderer.GetTiledPixelIdx(GetTile(px, py), px, py)];
+		}
+
+		int GetHiZBlockSize() const { return m_Renderer.m_HiZBlockSize; }
+
+		float GetHiZBlockDepth(int blockX, int blockY) const
+		{
+			const int numBlocksX{ (Width + m_Renderer.m_HiZBlockSize - 1) / m_Renderer.m_HiZBlockSize };
+			return m_Renderer.m_pHiZBlockDepth[blockX + blockY * numBlocksX];
+		}
+
+		const std::vector<Tile>& GetTiles() const { return m_Renderer.m_Tiles; }
+
+		//triangle in m_Triangles that ended up in front of the pixel
+		uint32_t GetVisibleTriangle(int px, int py)
+		{
+			return m_Renderer.m_pVisibilityBuffer[m_Renderer.GetTiledPixelIdx(GetTile(px, py), px, py)];
+		}
+
+		//every triangle in every tile it got binned to, like Render without the shading
+		void RasterizeTriangles()
+		{
+			ClearBuffers();
+			m_Renderer.BinTriangles();
+			for (Tile& tile : m_Renderer.m_Tiles) {
+				for (const uint32_t triangleIdx : tile.triangleIndices) {
+					m_Renderer.RasterizeTriangle(triangleIdx, tile);
+				}
+			}
+		}
+
+		//perspective correct uv of every drawn pixel against the uv of the original triangle at that pixel,
+		//a clipped piece that got its attributes wrong shows up as a jump at the clip edge or between the fan triangles
+		void ExpectAttributesContinuous(const std::vector<Vertex>& triangle)
+		{
+			RasterizeTriangles();
+			int numDrawn{};
+			for (int py{}; py < Height; ++py) {
+				for (int px{}; px < Width; ++px) {
+					const uint32_t triangleIdx{ GetVisibleTriangle(px, py) };
+					if (triangleIdx == m_Renderer.m_NoTriangle)
+						continue;
+					++numDrawn;
+
+					const TriangleSetup& setup{ GetTriangles()[triangleIdx] };
+					const float offsetX{ px + 0.5f - setup.raster.originX };
+					const float offsetY{ py + 0.5f - setup.raster.originY };
+					const float w{ 1.f / setup.raster.invW.Evaluate(offsetX, offsetY) };
+					const Vector2 uv{ setup.attributes.values[0].Evaluate(offsetX, offsetY) * w, setup.attributes.values[1].Evaluate(offsetX, offsetY) * w };
+
+					//vertices get snapped to the sub-pixel grid, so the uv can be off by a bit of what it changes over a pixel,
+					//near the horizon that is a lot more than anywhere else
+					const Vector2 expectedUV{ GetExpectedUV(m_Renderer.m_Camera, triangle, Width, Height, px, py) };
+					const Vector2 pixelStepX{ GetExpectedUV(m_Renderer.m_Camera, triangle, Width, Height, px + 1, py) - expectedUV };
+					const Vector2 pixelStepY{ GetExpectedUV(m_Renderer.m_Camera, triangle, Width, Height, px, py + 1) - expectedUV };
+					const float maxErrorX{ MaxUVError + MaxPixelStepError * (std::abs(pixelStepX.x) + std::abs(pixelStepY.x)) };
+					const float maxErrorY{ MaxUVError + MaxPixelStepError * (std::abs(pixelStepX.y) + std::abs(pixelStepY.y)) };
+					ASSERT_NEAR(uv.x, expectedUV.x, maxErrorX) << "pixel " << px << ", " << py << " of triangle " << triangleIdx;
+					ASSERT_NEAR(uv.y, expectedUV.y, maxErrorY) << "pixel " << px << ", " << py << " of triangle " << triangleIdx;
+				}
+			}
+			EXPECT_GT(numDrawn, 0);
+		}
+
+		//how many triangles drew every pixel (row-major), each one rasterized on its own so none can hide another
+		std::vector<int> CountCoverage()
+		{
+			m_Renderer.BinTriangles();
+			std::vector<int> coverage(Width * Height);
+			for (uint32_t triangleIdx{}; triangleIdx < GetTriangles().size(); ++triangleIdx) {
+				ClearBuffers();
+				for (Tile& tile : m_Renderer.m_Tiles) {
+					if (std::find(tile.triangleIndices.begin(), tile.triangleIndices.end(), triangleIdx) != tile.triangleIndices.end())
+						m_Renderer.RasterizeTriangle(triangleIdx, tile);
+				}
+				for (int py{}; py < Height; ++py) {
+					for (int px{}; px < Width; ++px) {
+						coverage[px + py * Width] += GetVisibleTriangle(px, py) == triangleIdx;
+					}
+				}
+			}
+			return coverage;
+		}
+	};
+
+	//--- fill rule ---
+
+	TEST_F(RendererTest, SharedEdgesDrawEveryPixelOnce) {
+		//grid of quads over the whole screen with the inner vertices moved by whole sub-pixel steps, every quad split along
+		//one of its diagonals, so the edges go every direction and mostly start and end in the middle of a span
+		constexpr int quadsX{ 7 };
+		constexpr int quadsY{ 5 };
+		std::mt19937 random{ 1234 };
+		std::uniform_int_distribution<int> jitter{ -6 * SubPixelScale, 6 * SubPixelScale };
+
+		std::vector<Vector2> positions{};
+		for (int y{}; y <= quadsY; ++y) {
+			for (int x{}; x <= quadsX; ++x) {
+				Vector2 position{ float(x * Width) / quadsX, float(y * Height) / quadsY };
+				//the border stays on the screen border, so together the triangles cover every pixel
+				if (x != 0 && x != quadsX)
+					position.x = std::round(position.x) + float(jitter(random)) / SubPixelScale;
+				if (y != 0 && y != quadsY)
+					position.y = std::round(position.y) + float(jitter(random)) / SubPixelScale;
+				positions.push_back(position);
+			}
+		}
+		//one row and one column exactly through pixel centers, so the shared horizontal and vertical edges
+		//there only get split by the top-left rule
+		for (int x{}; x <= quadsX; ++x) {
+			positions[x + 2 * (quadsX + 1)].y = 48.5f;
+		}
+		for (int y{}; y <= quadsY; ++y) {
+			positions[3 + y * (quadsX + 1)].x = 85.5f;
+		}
+
+		std::vector<uint32_t> indices{};
+		for (int y{}; y < quadsY; ++y) {
+			for (int x{}; x < quadsX; ++x) {
+				const uint32_t corner{ uint32_t(x + y * (quadsX + 1)) };
+				const uint32_t right{ corner + 1 }, down{ corner + quadsX + 1 }, downRight{ down + 1 };
+				//both windings, cull mode none flips the back facing ones in setup
+				if ((x + y) % 2 == 0)
+					indices.insert(indices.end(), { corner, right, downRight, corner, downRight, down });
+				else
+					indices.insert(indices.end(), { corner, down, right, right, down, downRight });
+			}
+		}
+		SetupScreenTriangles(positions, indices);
+		ASSERT_EQ(GetTriangles().size(), size_t(quadsX * quadsY * 2));
+
+		for (RasterKernel kernel : GetSupportedKernels()) {
+			SCOPED_TRACE(GetRasterKernelName(kernel));
+			SetRasterKernel(kernel);
+			const std::vector<int> coverage{ CountCoverage() };
+			for (int py{}; py < Height; ++py) {
+				for (int px{}; px < Width; ++px) {
+					ASSERT_EQ(coverage[px + py * Width], 1) << "pixel " << px << ", " << py;
+				}
+			}
+		}
+	}
+
+	//--- clipping ---
+
+	TEST_F(RendererTest, ClipNearPlaneStraddle) {
+		LookFrom({ 0.f, 0.f, 0.f });
+
+		//one vertex behind the camera: the near plane cuts off a corner and leaves a quad
+		const std::vector<Vertex> oneBehind{
+			MakeVertex({ 0.f, -0.5f, -2.f }, { 0.5f, 0.f }),
+			MakeVertex({ -1.f, -0.5f, 4.f }, { 0.f, 1.f }),
+			MakeVertex({ 1.f, -0.5f, 4.f }, { 1.f, 1.f }) };
+		Mesh mesh{ TransformTriangles(oneBehind) };
+		const std::vector<Vertex_Out>& verticesOut{ mesh.vertices_out };
+		ASSERT_NE(verticesOut[0].clipFlags & ClipNear, 0);
+		ASSERT_EQ(verticesOut[1].clipFlags, 0);
+		ASSERT_EQ(verticesOut[2].clipFlags, 0);
+
+		std::vector<Vertex_Out> polygon{};
+		EXPECT_EQ(ClipPolygon(verticesOut[0], verticesOut[1], verticesOut[2], polygon), 4);
+		for (const Vertex_Out& vertex : polygon) {
+			EXPECT_EQ(vertex.clipFlags, 0);
+			EXPECT_GE(vertex.position.z, 0.f);
+			EXPECT_GT(vertex.position.w, 0.f);
+		}
+
+		SetupTriangles(mesh);
+		EXPECT_EQ(GetTriangles().size(), 2u);
+		ExpectAttributesContinuous(oneBehind);
+
+		//two behind: only the tip in front of the near plane is left
+		GetTriangles().clear();
+		const std::vector<Vertex> twoBehind{
+			MakeVertex({ -1.f, -0.5f, -2.f }, { 0.f, 0.f }),
+			MakeVertex({ 0.f, -0.5f, 4.f }, { 0.5f, 1.f }),
+			MakeVertex({ 1.f, -0.5f, -2.f }, { 1.f, 0.f }) };
+		mesh = TransformTriangles(twoBehind);
+		EXPECT_EQ(ClipPolygon(mesh.vertices_out[0], mesh.vertices_out[1], mesh.vertices_out[2], polygon), 3);
+		SetupTriangles(mesh);
+		EXPECT_EQ(GetTriangles().size(), 1u);
+		ExpectAttributesContinuous(twoBehind);
+	}
+
+	TEST_F(RendererTest, ClipGuardBandCrossing) {
+		LookFrom({ 0.f, 0.f, 0.f });
+
+		//far wider than the guard band on both sides, in front of the camera the whole way
+		const std::vector<Vertex> wide{
+			MakeVertex({ -100.f, -0.5f, 10.f }, { 0.f, 0.f }),
+			MakeVertex({ 0.f, -0.5f, 20.f }, { 0.5f, 1.f }),
+			MakeVertex({ 100.f, -0.5f, 10.f }, { 1.f, 0.f }) };
+		Mesh mesh{ TransformTriangles(wide) };
+		const std::vector<Vertex_Out>& verticesOut{ mesh.vertices_out };
+		ASSERT_EQ(verticesOut[0].clipFlags & (ClipNear | ClipFar), 0);
+		ASSERT_NE(verticesOut[0].clipFlags & ClipGuardBand, 0);
+		ASSERT_NE(verticesOut[2].clipFlags & ClipGuardBand, 0);
+
+		//the left and right guard band planes both cut off a corner
+		std::vector<Vertex_Out> polygon{};
+		EXPECT_EQ(ClipPolygon(verticesOut[0], verticesOut[1], verticesOut[2], polygon), 5);
+
+		//everything left is inside the guard band, which in pixels goes guardBand screens out from the center
+		const float maxOffsetX{ (GetGuardBand() + 1.f) / 2.f * Width };
+		for (const Vertex_Out& vertex : polygon) {
+			EXPECT_EQ(vertex.clipFlags, 0);
+			EXPECT_GE(vertex.position.x, Width - maxOffsetX - 0.01f);
+			EXPECT_LE(vertex.position.x, maxOffsetX + 0.01f);
+		}
+
+		SetupTriangles(mesh);
+		EXPECT_FALSE(GetTriangles().empty());
+		ExpectAttributesContinuous(wide);
+	}
+
+	TEST_F(RendererTest, ClipTrivialReject) {
+		LookFrom({ 0.f, 0.f, 0.f });
+
+		//all three left of the frustum (and out of the guard band), never on screen even though it crosses the view direction in depth
+		const std::vector<Vertex> left{
+			MakeVertex({ -200.f, 0.f, 10.f }, {}),
+			MakeVertex({ -300.f, 5.f, 50.f }, {}),
+			MakeVertex({ -200.f, -5.f, 30.f }, {}) };
+		Mesh mesh{ TransformTriangles(left) };
+		for (const Vertex_Out& vertex : mesh.vertices_out) {
+			ASSERT_NE(vertex.clipFlags & ClipLeft, 0);
+		}
+		SetupTriangles(mesh);
+		EXPECT_TRUE(GetTriangles().empty());
+
+		//completely behind the camera
+		const std::vector<Vertex> behind{
+			MakeVertex({ -1.f, 0.f, -5.f }, {}),
+			MakeVertex({ 0.f, 1.f, -5.f }, {}),
+			MakeVertex({ 1.f, 0.f, -5.f }, {}) };
+		mesh = TransformTriangles(behind);
+		SetupTriangles(mesh);
+		EXPECT_TRUE(GetTriangles().empty());
+
+		//nothing on screen either when clipping gets to it: all of it is past the far plane
+		const std::vector<Vertex> past{
+			MakeVertex({ -1.f, 0.f, 5000.f }, {}),
+			MakeVertex({ 0.f, 1.f, 5000.f }, {}),
+			MakeVertex({ 1.f, 0.f, 5000.f }, {}) };
+		mesh = TransformTriangles(past);
+		std::vector<Vertex_Out> polygon{};
+		EXPECT_LT(ClipPolygon(mesh.vertices_out[0], mesh.vertices_out[1], mesh.vertices_out[2], polygon), 3);
+		SetupTriangles(mesh);
+		EXPECT_TRUE(GetTriangles().empty());
+	}
+
+	//--- hi-z ---
+
+	TEST_F(RendererTest, HiZNeverBelowItsPixels) {
+		LookFrom({ 0.f, 0.f, 0.f });
+
+		//overlapping triangles at every depth and angle, so blocks end up partly covered, overwritten and left empty
+		std::mt19937 random{ 1234 };
+		std::uniform_real_distribution<float> center{ -1.f, 1.f };
+		std::uniform_real_distribution<float> depth{ 5.f, 60.f };
+		std::uniform_real_distribution<float> offset{ -6.f, 6.f };
+		std::vector<Vertex> vertices{};
+		for (int triangleIdx{}; triangleIdx < 150; ++triangleIdx) {
+			const float triangleDepth{ depth(random) };
+			//spread over the view, which gets wider with the depth
+			const Vector3 triangleCenter{ center(random) * triangleDepth * 0.9f, center(random) * triangleDepth * 0.5f, triangleDepth };
+			for (int corner{}; corner < 3; ++corner) {
+				vertices.push_back(MakeVertex(triangleCenter + Vector3{ offset(random), offset(random), offset(random) }, {}));
+			}
+		}
+		const Mesh mesh{ TransformTriangles(vertices) };
+		SetupTriangles(mesh);
+		ASSERT_GT(GetTriangles().size(), 100u);
+
+		const int blockSize{ GetHiZBlockSize() };
+		for (RasterKernel kernel : GetSupportedKernels()) {
+			SCOPED_TRACE(GetRasterKernelName(kernel));
+			SetRasterKernel(kernel);
+			RasterizeTriangles();
+
+			int numDrawnBlocks{};
+			for (int blockY{}; blockY * blockSize < Height; ++blockY) {
+				for (int blockX{}; blockX * blockSize < Width; ++blockX) {
+					//a block max closer than one of its pixels would let the hi-z throw away triangles that are in front of it
+					const float blockDepth{ GetHiZBlockDepth(blockX, blockY) };
+					float maxDepth{};
+					for (int py{ blockY * blockSize }; py < std::min((blockY + 1) * blockSize, Height); ++py) {
+						for (int px{ blockX * blockSize }; px < std::min((blockX + 1) * blockSize, Width); ++px) {
+							maxDepth = std::max(maxDepth, GetDepth(px, py));
+						}
+					}
+					ASSERT_GE(blockDepth, maxDepth) << "block " << blockX << ", " << blockY;
+					//every block that got drawn to is redone, one that is left too far still works but culls less
+					EXPECT_EQ(blockDepth, maxDepth) << "block " << blockX << ", " << blockY;
+					numDrawnBlocks += blockDepth < FLT_MAX;
+				}
+			}
+			//otherwise every block is still at FLT_MAX and nothing got tested
+			EXPECT_GT(numDrawnBlocks, 50);
+
+			for (const Tile& tile : GetTiles()) {
+				const BoundingBox& tileBox{ tile.boundingBox };
+				for (int blockY{ tileBox.top / blockSize }; blockY * blockSize < tileBox.bottom; ++blockY) {
+					for (int blockX{ tileBox.left / blockSize }; blockX * blockSize < tileBox.right; ++blockX) {
+						ASSERT_GE(tile.maxDepth, GetHiZBlockDepth(blockX, blockY)) << "tile at " << tileBox.left << ", " << tileBox.top;
+					}
+				}
+			}
+		}
+	}
+
+	//--- instancing ---
+
+	TEST_F(RendererTest, InstancesGetTheirOwnCullingAndLod) {
+		LookFrom({ 0.f, 0.f, 0.f });
+
+		//40 x 30 units around its own origin, with lods and meshlets like the vehicle gets them
+		Mesh mesh{};
+		TestMeshes::MakeBumpyGrid(40, 30, mesh.vertices, mesh.indices);
+		for (Vertex& vertex : mesh.vertices) {
+			vertex.position -= Vector3{ 20.f, 15.f, 0.f };
+		}
+		mesh.primitiveTopology = PrimitiveTopology::TriangleList;
+		mesh.cullMode = CullMode::None;
+		Utils::BuildLodChain(mesh.vertices, mesh.indices, mesh.lods);
+		Utils::BuildMeshlets(mesh.vertices, mesh.indices, mesh.meshlets);
+		mesh.CalculateBounds();
+		ASSERT_GE(mesh.lods.size(), 2u);
+
+		//the camera is inside the bounds of the first one, so it has to be the full mesh and only some meshlets are in view
+		const std::vector<MeshInstance> instances{
+			MeshInstance{ Matrix::CreateTranslation(0.f, 0.f, 10.f) },
+			MeshInstance{ Matrix::CreateTranslation(0.f, 0.f, 40.f) },
+			MeshInstance{ Matrix::CreateTranslation(0.f, 0.f, 800.f) },
+			MeshInstance{ Matrix::CreateTranslation(0.f, 0.f, -100.f) }, //behind the camera
+			MeshInstance{ Matrix::CreateTranslation(-600.f, 0.f, 100.f) } }; //left of the frustum
+		const bool expectedVisible[]{ true, true, true, false, false };
+
+		//every instance on its own first, the full mesh should only get the meshlets that are in view
+		std::vector<size_t> numTriangles{};
+		for (size_t instanceIdx{}; instanceIdx < instances.size(); ++instanceIdx) {
+			SCOPED_TRACE("instance " + std::to_string(instanceIdx));
+			mesh.instances = { instances[instanceIdx] };
+			GetTriangles().clear();
+			SetupInstances(mesh);
+
+			const MeshInstance& instance{ mesh.instances[0] };
+			EXPECT_EQ(instance.isVisible, expectedVisible[instanceIdx]);
+			EXPECT_EQ(instance.activeLod, SelectLod(mesh, instance.worldMatrix));
+			numTriangles.push_back(GetTriangles().size());
+			if (instance.activeLod == 0)
+				EXPECT_TRUE(std::any_of(mesh.meshlets.begin(), mesh.meshlets.end(), [](const Meshlet& meshlet) { return !meshlet.isVisible; }));
+			if (!expectedVisible[instanceIdx]) {
+				EXPECT_EQ(numTriangles.back(), 0u);
+				continue;
+			}
+
+			const Mesh& lod{ mesh.GetLod(instance.activeLod) };
+			EXPECT_GT(numTriangles.back(), 0u);
+			EXPECT_LE(numTriangles.back(), lod.indices.size() / 3);
+		}
+
+		//the near one only gets the meshlets that are in view
+		EXPECT_LT(numTriangles[0], mesh.indices.size() / 3);
+
+		//closer gets more detail
+		mesh.instances = instances;
+		GetTriangles().clear();
+		SetupInstances(mesh);
+		EXPECT_EQ(mesh.instances[0].activeLod, 0);
+		EXPECT_GT(mesh.instances[1].activeLod, mesh.instances[0].activeLod);
+		EXPECT_GT(mesh.instances[2].activeLod, mesh.instances[1].activeLod);
+
+		//all together they take turns on the same buffers, that must not change what any of them draws
+		size_t expectedTotal{};
+		for (size_t instanceIdx{}; instanceIdx < instances.size(); ++instanceIdx) {
+			EXPECT_EQ(mesh.instances[instanceIdx].isVisible, expectedVisible[instanceIdx]) << "instance " << instanceIdx;
+			expectedTotal += numTriangles[instanceIdx];
+		}
+		EXPECT_EQ(GetTriangles().size(), expectedTotal);
+	}
+}
@@ -0,0 +1,22 @@
+#pragma once
+#include <vector>
+#include "RasterKernels.h"
+
+//the simd tests run every kernel the machine has, the scalar one is what the others get compared to
+namespace dae
+{
+	namespace TestKernels
+	{
+		//every kernel this cpu can run, scalar first
+		inline std::vector<RasterKernel> GetSupportedKernels()
+		{
+			std::vector<RasterKernel> kernels{ RasterKernel::Scalar };
+			const RasterKernel best{ GetBestRasterKernel() };
+			if (best != RasterKernel::Scalar)
+				kernels.push_back(RasterKernel::SSE);
+			if (best == RasterKernel::AVX2)
+				kernels.push_back(RasterKernel::AVX2);
+			return kernels;
+		}
+	}
+}
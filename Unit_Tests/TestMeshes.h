@@ -0,0 +1,143 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <random>
+#include <vector>
+#include "Maths.h"
+#include "DataTypes.h"
+
+//meshes the mesh processing tests run on, a regular grid alone hides what happens on real (messy) input
+namespace dae
+{
+	namespace TestMeshes
+	{
+		//flat grid in the xy plane facing +z, two triangles per quad
+		inline void MakeGrid(int quadsX, int quadsY, std::vector<Vertex>& vertices, std::vector<uint32_t>& indices)
+		{
+			vertices.clear();
+			indices.clear();
+			for (int y{}; y <= quadsY; ++y) {
+				for (int x{}; x <= quadsX; ++x) {
+					Vertex vertex{};
+					vertex.position = Vector3{ float(x), float(y), 0.f };
+					vertex.uv = Vector2{ float(x) / quadsX, float(y) / quadsY };
+					vertex.normal = Vector3::UnitZ;
+					vertex.tangent = Vector3::UnitX;
+					vertices.push_back(vertex);
+				}
+			}
+			for (int y{}; y < quadsY; ++y) {
+				for (int x{}; x < quadsX; ++x) {
+					const uint32_t corner{ uint32_t(y * (quadsX + 1) + x) };
+					const uint32_t right{ corner + 1 }, up{ corner + uint32_t(quadsX + 1) }, upRight{ up + 1 };
+					indices.insert(indices.end(), { corner, right, upRight, corner, upRight, up });
+				}
+			}
+		}
+
+		//grid with its inner vertices moved around and curved into a bump, so the triangles differ in size, shape and direction
+		inline void MakeBumpyGrid(int quadsX, int quadsY, std::vector<Vertex>& vertices, std::vector<uint32_t>& indices, uint32_t seed = 1234)
+		{
+			MakeGrid(quadsX, quadsY, vertices, indices);
+			std::mt19937 random{ seed };
+			std::uniform_real_distribution<float> jitter{ -0.35f, 0.35f };
+			for (Vertex& vertex : vertices) {
+				const bool isBorder{ vertex.position.x == 0.f || vertex.position.y == 0.f || vertex.position.x == float(quadsX) || vertex.position.y == float(quadsY) };
+				if (!isBorder) {
+					vertex.position.x += jitter(random);
+					vertex.position.y += jitter(random);
+				}
+				vertex.position.z = 3.f * std::sin(vertex.position.x * 0.25f) * std::cos(vertex.position.y * 0.15f);
+			}
+		}
+
+		//triangles that share nothing, scattered in a box and facing every way
+		inline void MakeSoup(size_t numTriangles, std::vector<Vertex>& vertices, std::vector<uint32_t>& indices, uint32_t seed = 1234)
+		{
+			vertices.clear();
+			indices.clear();
+			std::mt19937 random{ seed };
+			std::uniform_real_distribution<float> center{ -50.f, 50.f };
+			std::uniform_real_distribution<float> offset{ -1.f, 1.f };
+			for (size_t triangleIdx{}; triangleIdx < numTriangles; ++triangleIdx) {
+				const Vector3 triangleCenter{ center(random), center(random), center(random) };
+				Vector3 corners[3]{};
+				for (Vector3& corner : corners) {
+					corner = triangleCenter + Vector3{ offset(random), offset(random), offset(random) };
+				}
+				Vector3 normal{ Vector3::Cross(corners[1] - corners[0], corners[2] - corners[0]) };
+				normal = normal.SqrMagnitude() > 0.f ? normal.Normalized() : Vector3::UnitZ;
+
+				for (const Vector3& corner : corners) {
+					indices.push_back(uint32_t(vertices.size()));
+					Vertex vertex{};
+					vertex.position = corner;
+					vertex.normal = normal;
+					vertex.tangent = Vector3::Cross(normal, std::abs(normal.x) < 0.9f ? Vector3::UnitX : Vector3::UnitY).Normalized();
+					vertices.push_back(vertex);
+				}
+			}
+		}
+
+		inline std::vector<std::array<uint32_t, 3>> GetTriangles(const std::vector<uint32_t>& indices)
+		{
+			std::vector<std::array<uint32_t, 3>> triangles{};
+			for (size_t indexIdx{}; indexIdx + 2 < indices.size(); indexIdx += 3) {
+				triangles.push_back({ indices[indexIdx], indices[indexIdx + 1], indices[indexIdx + 2] });
+			}
+			return triangles;
+		}
+
+		inline void ShuffleTriangles(std::vector<uint32_t>& indices, uint32_t seed = 1234)
+		{
+			std::vector<std::array<uint32_t, 3>> triangles{ GetTriangles(indices) };
+			std::shuffle(triangles.begin(), triangles.end(), std::mt19937{ seed });
+			indices.clear();
+			for (const auto& triangle : triangles) {
+				indices.insert(indices.end(), triangle.begin(), triangle.end());
+			}
+		}
+
+		//the triangles by corner positions, sorted, for comparing meshes that got their vertices duplicated or renumbered
+		inline std::vector<std::array<float, 9>> GetTrianglePositions(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices)
+		{
+			std::vector<std::array<float, 9>> positions{};
+			for (const auto& triangle : GetTriangles(indices)) {
+				std::array<float, 9> corners{};
+				for (int corner{}; corner < 3; ++corner) {
+					const Vector3& position{ vertices[triangle[corner]].position };
+					corners[corner * 3] = position.x;
+					corners[corner * 3 + 1] = position.y;
+					corners[corner * 3 + 2] = position.z;
+				}
+				positions.push_back(corners);
+			}
+			std::sort(positions.begin(), positions.end());
+			return positions;
+		}
+
+		//the inputs the mesh processing tests loop over: ordered, shuffled, irregular and disconnected
+		struct NamedMesh
+		{
+			const char* name;
+			std::vector<Vertex> vertices;
+			std::vector<uint32_t> indices;
+		};
+
+		inline std::vector<NamedMesh> MakeTestMeshes()
+		{
+			std::vector<NamedMesh> meshes(4);
+			meshes[0].name = "grid";
+			MakeGrid(40, 30, meshes[0].vertices, meshes[0].indices);
+			meshes[1].name = "shuffled grid";
+			MakeGrid(40, 30, meshes[1].vertices, meshes[1].indices);
+			ShuffleTriangles(meshes[1].indices);
+			meshes[2].name = "bumpy grid";
+			MakeBumpyGrid(40, 30, meshes[2].vertices, meshes[2].indices);
+			ShuffleTriangles(meshes[2].indices);
+			meshes[3].name = "soup";
+			MakeSoup(2000, meshes[3].vertices, meshes[3].indices);
+			return meshes;
+		}
+	}
+}
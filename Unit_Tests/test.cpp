@@ -1,5 +1,18 @@
 #include "gtest/gtest.h"
 #include "Maths.h"
+#include "DataTypes.h"
+#include "Utils.h"
+#include "Texture.h"
+#include "Camera.h"
+#include "TestMeshes.h"
+#include "SDL.h"
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <string>
 
 
 namespace dae
@@ -9,4 +22,527 @@ namespace dae
 		EXPECT_TRUE(true);
 	}
 
+	//--- camera ---
+
+	TEST(Camera, VersionFollowsEveryMove) {
+		Camera camera{};
+		camera.Initialize(60.f, { 0.f, 0.f, 0.f }, 1.f);
+		camera.UpdateMatrices();
+		const uint32_t version{ camera.version };
+
+		camera.UpdateMatrices();
+		EXPECT_EQ(camera.version, version);
+
+		//less than the epsilon of Matrix ==, but the vertices still have to move
+		camera.origin.x += 5e-7f;
+		camera.UpdateMatrices();
+		EXPECT_EQ(camera.version, version + 1);
+
+		camera.aspectRatio = std::nextafter(camera.aspectRatio, 2.f);
+		camera.UpdateMatrices();
+		EXPECT_EQ(camera.version, version + 2);
+	}
+
+	//--- Vertex_Out packing ---
+
+	TEST(Packing, HalfRoundTripsEveryHalf) {
+		for (uint32_t half{}; half <= 0xffff; ++half) {
+			const float value{ HalfToFloat(uint16_t(half)) };
+			if (std::isnan(value))
+				continue;
+			EXPECT_EQ(FloatToHalf(value), half) << "half " << std::hex << half;
+		}
+	}
+
+	TEST(Packing, HalfKnownValues) {
+		EXPECT_EQ(FloatToHalf(0.f), 0x0000);
+		EXPECT_EQ(FloatToHalf(-0.f), 0x8000);
+		EXPECT_EQ(FloatToHalf(1.f), 0x3c00);
+		EXPECT_EQ(FloatToHalf(-2.f), 0xc000);
+		EXPECT_EQ(FloatToHalf(65504.f), 0x7bff);
+		EXPECT_EQ(FloatToHalf(1e6f), 0x7c00);
+		EXPECT_EQ(FloatToHalf(std::ldexp(1.f, -24)), 0x0001); //smallest denormal
+		EXPECT_TRUE(std::isnan(HalfToFloat(FloatToHalf(std::nanf("")))));
+	}
+
+	//halfway cases go to the even one, like the F16C conversion in the AVX2 vertex kernel
+	TEST(Packing, HalfRoundsTiesToEven) {
+		const float ulp{ std::ldexp(1.f, -10) };
+		EXPECT_EQ(FloatToHalf(1.f + ulp * 0.5f), 0x3c00);
+		EXPECT_EQ(FloatToHalf(1.f + ulp * 1.5f), 0x3c02);
+		EXPECT_EQ(FloatToHalf(1.f + ulp * 0.5f + ulp * 0.01f), 0x3c01);
+		EXPECT_EQ(FloatToHalf(65520.f), 0x7c00); //halfway between the biggest half and infinity
+		EXPECT_EQ(FloatToHalf(std::ldexp(1.f, -25)), 0x0000); //halfway between 0 and the smallest denormal
+		EXPECT_EQ(FloatToHalf(std::ldexp(3.f, -25)), 0x0002);
+	}
+
+	TEST(Packing, UnitVectorRoundTrip) {
+		//points spread over the whole sphere, so every octant and the folded half get hit
+		constexpr int numPoints{ 10000 };
+		float maxError{};
+		for (int pointIdx{}; pointIdx < numPoints; ++pointIdx) {
+			const float z{ 1.f - 2.f * (pointIdx + 0.5f) / numPoints };
+			const float radius{ std::sqrt(1.f - z * z) };
+			const float angle{ pointIdx * 2.39996323f };
+			const Vector3 vector{ radius * std::cos(angle), radius * std::sin(angle), z };
+
+			const Vector3 unpacked{ UnpackUnitVector(PackUnitVector(vector)) };
+			EXPECT_NEAR(unpacked.Magnitude(), 1.f, 1e-5f);
+			maxError = std::max(maxError, (unpacked - vector).Magnitude());
+		}
+		EXPECT_LT(maxError, 1e-4f);
+
+		for (const Vector3& axis : { Vector3::UnitX, Vector3::UnitY, Vector3::UnitZ, -Vector3::UnitX, -Vector3::UnitY, -Vector3::UnitZ }) {
+			EXPECT_NEAR((UnpackUnitVector(PackUnitVector(axis)) - axis).Magnitude(), 0.f, 1e-5f);
+		}
+	}
+
+	//--- mesh processing ---
+
+	using namespace TestMeshes;
+
+	TEST(ObjParser, WeldsOnlyCornersThatShareEverything) {
+		//a quad, then the same corner again with another uv and another normal
+		const std::filesystem::path filename{ std::filesystem::temp_directory_path() / "weld_test.obj" };
+		{
+			std::ofstream file{ filename };
+			file << "v 0 0 0\nv 1 0 0\nv 1 1 0\nv 0 1 0\n"
+				<< "vt 0 0\nvt 1 0\nvt 1 1\n"
+				<< "vn 0 0 1\nvn 0 1 0\n"
+				<< "f 1/1/1 2/2/1 3/3/1\n"
+				<< "f 1/1/1 3/3/1 4/1/1\n" //1/1/1 and 3/3/1 again, welded
+				<< "f 1/2/1 2/2/1 4/1/1\n" //1 with only another uv
+				<< "f 1/1/2 2/2/1 3/3/1\n"; //1 with only another normal
+		}
+
+		std::vector<Vertex> vertices{};
+		std::vector<uint32_t> indices{};
+		const bool isParsed{ Utils::ParseOBJ(filename.string(), vertices, indices, false) };
+		std::filesystem::remove(filename);
+		ASSERT_TRUE(isParsed);
+
+		//12 corners, 4 of them repeat an earlier one exactly
+		ASSERT_EQ(indices.size(), 12u);
+		EXPECT_EQ(vertices.size(), 6u);
+
+		//every corner still gets its own uv and normal, the vertex cache pass is free to reorder the triangles
+		using Corner = std::array<float, 8>;
+		const auto getCorner{ [](const Vertex& vertex) {
+			return Corner{ vertex.position.x, vertex.position.y, vertex.position.z, vertex.uv.x, vertex.uv.y, vertex.normal.x, vertex.normal.y, vertex.normal.z };
+		} };
+		std::vector<Corner> uniqueCorners{};
+		for (const Vertex& vertex : vertices) {
+			uniqueCorners.push_back(getCorner(vertex));
+		}
+		std::sort(uniqueCorners.begin(), uniqueCorners.end());
+		EXPECT_EQ(std::unique(uniqueCorners.begin(), uniqueCorners.end()), uniqueCorners.end());
+
+		const Vector3 p[]{ { 0.f, 0.f, 0.f }, { 1.f, 0.f, 0.f }, { 1.f, 1.f, 0.f }, { 0.f, 1.f, 0.f } };
+		const Vector2 uv[]{ { 0.f, 1.f }, { 1.f, 1.f }, { 1.f, 0.f } }; //v is flipped
+		const Vector3 n[]{ { 0.f, 0.f, 1.f }, { 0.f, 1.f, 0.f } };
+		const auto makeCorner{ [](const Vector3& position, const Vector2& uv, const Vector3& normal) {
+			return Corner{ position.x, position.y, position.z, uv.x, uv.y, normal.x, normal.y, normal.z };
+		} };
+		std::vector<std::array<Corner, 3>> expectedTriangles{
+			{ makeCorner(p[0], uv[0], n[0]), makeCorner(p[1], uv[1], n[0]), makeCorner(p[2], uv[2], n[0]) },
+			{ makeCorner(p[0], uv[0], n[0]), makeCorner(p[2], uv[2], n[0]), makeCorner(p[3], uv[0], n[0]) },
+			{ makeCorner(p[0], uv[1], n[0]), makeCorner(p[1], uv[1], n[0]), makeCorner(p[3], uv[0], n[0]) },
+			{ makeCorner(p[0], uv[0], n[1]), makeCorner(p[1], uv[1], n[0]), makeCorner(p[2], uv[2], n[0]) } };
+		std::vector<std::array<Corner, 3>> triangles{};
+		for (const auto& triangle : GetTriangles(indices)) {
+			std::array<Corner, 3> corners{ getCorner(vertices[triangle[0]]), getCorner(vertices[triangle[1]]), getCorner(vertices[triangle[2]]) };
+			//same winding, but any corner can come first
+			std::rotate(corners.begin(), std::min_element(corners.begin(), corners.end()), corners.end());
+			triangles.push_back(corners);
+		}
+		for (auto& corners : expectedTriangles) {
+			std::rotate(corners.begin(), std::min_element(corners.begin(), corners.end()), corners.end());
+		}
+		std::sort(triangles.begin(), triangles.end());
+		std::sort(expectedTriangles.begin(), expectedTriangles.end());
+		EXPECT_EQ(triangles, expectedTriangles);
+	}
+
+	TEST(VertexCache, OptimizeKeepsEveryTriangle) {
+		for (NamedMesh& mesh : MakeTestMeshes()) {
+			const std::vector<uint32_t> original{ mesh.indices };
+
+			Utils::OptimizeVertexCache(mesh.indices, mesh.vertices.size());
+
+			//same triangles with the same winding, only the order changed
+			ASSERT_EQ(mesh.indices.size(), original.size()) << mesh.name;
+			std::vector<std::array<uint32_t, 3>> before{ GetTriangles(original) };
+			std::vector<std::array<uint32_t, 3>> after{ GetTriangles(mesh.indices) };
+			std::sort(before.begin(), before.end());
+			std::sort(after.begin(), after.end());
+			EXPECT_EQ(before, after) << mesh.name;
+		}
+	}
+
+	TEST(VertexCache, OptimizeDoesNotMakeACMRWorse) {
+		//already decent (rows), as bad as it gets (shuffled), and nothing to share at all (soup)
+		for (NamedMesh& mesh : MakeTestMeshes()) {
+			const bool isSoup{ std::string{ mesh.name } == "soup" };
+			const float acmrBefore{ Utils::CalculateACMR(mesh.indices, mesh.vertices.size()) };
+			Utils::OptimizeVertexCache(mesh.indices, mesh.vertices.size());
+			const float acmrAfter{ Utils::CalculateACMR(mesh.indices, mesh.vertices.size()) };
+			EXPECT_LE(acmrAfter, acmrBefore) << mesh.name;
+			if (isSoup)
+				EXPECT_FLOAT_EQ(acmrAfter, 3.f);
+			else
+				EXPECT_LT(acmrAfter, 0.8f) << mesh.name;
+		}
+	}
+
+	TEST(VertexCache, ACMRKnownValues) {
+		//every triangle on its own vertices misses 3 times
+		EXPECT_FLOAT_EQ(Utils::CalculateACMR({ 0, 1, 2, 3, 4, 5 }, 6), 3.f);
+		//the second one only adds one vertex
+		EXPECT_FLOAT_EQ(Utils::CalculateACMR({ 0, 1, 2, 2, 1, 3 }, 4), 2.f);
+		EXPECT_FLOAT_EQ(Utils::CalculateACMR({}, 0), 0.f);
+	}
+
+	TEST(Meshlets, RespectLimitsAndKeepEveryTriangle) {
+		for (const NamedMesh& mesh : MakeTestMeshes()) {
+			//the same triangle, but by position because the meshlets duplicate their border vertices
+			const auto meshPositions{ GetTrianglePositions(mesh.vertices, mesh.indices) };
+
+			const std::pair<size_t, size_t> limits[]{ { 64, 64 }, { 128, 128 }, { 32, 20 }, { 10, 64 }, { 64, 7 } };
+			for (const auto& [maxVertices, maxTriangles] : limits) {
+				std::vector<Vertex> vertices{ mesh.vertices };
+				std::vector<uint32_t> indices{ mesh.indices };
+				std::vector<Meshlet> meshlets{};
+				Utils::BuildMeshlets(vertices, indices, meshlets, maxVertices, maxTriangles);
+
+				//back to back ranges that cover everything, each meshlet only uses its own vertices
+				uint32_t nextVertex{}, nextTriangle{};
+				for (const Meshlet& meshlet : meshlets) {
+					EXPECT_GT(meshlet.triangleCount, 0u);
+					EXPECT_LE(meshlet.vertexCount, maxVertices);
+					EXPECT_LE(meshlet.triangleCount, maxTriangles);
+					EXPECT_EQ(meshlet.firstVertex, nextVertex);
+					EXPECT_EQ(meshlet.firstTriangle, nextTriangle);
+					for (uint32_t indexIdx{ meshlet.firstTriangle * 3 }; indexIdx < (meshlet.firstTriangle + meshlet.triangleCount) * 3; ++indexIdx) {
+						EXPECT_GE(indices[indexIdx], meshlet.firstVertex);
+						EXPECT_LT(indices[indexIdx], meshlet.firstVertex + meshlet.vertexCount);
+					}
+					nextVertex += meshlet.vertexCount;
+					nextTriangle += meshlet.triangleCount;
+				}
+				EXPECT_EQ(nextVertex, vertices.size()) << mesh.name;
+				EXPECT_EQ(size_t(nextTriangle) * 3, indices.size()) << mesh.name;
+				EXPECT_EQ(GetTrianglePositions(vertices, indices), meshPositions) << mesh.name << " " << maxVertices << "/" << maxTriangles;
+			}
+		}
+	}
+
+	TEST(Meshlets, FlatMeshGetsTightCones) {
+		std::vector<Vertex> vertices{};
+		std::vector<uint32_t> indices{};
+		MakeGrid(20, 20, vertices, indices);
+		std::vector<Meshlet> meshlets{};
+		Utils::BuildMeshlets(vertices, indices, meshlets);
+
+		ASSERT_FALSE(meshlets.empty());
+		for (const Meshlet& meshlet : meshlets) {
+			EXPECT_NEAR(Vector3::Dot(meshlet.coneAxis, Vector3::UnitZ), 1.f, 1e-5f);
+			EXPECT_NEAR(meshlet.coneCutoff, 0.f, 1e-3f);
+		}
+	}
+
+	//the meshlets cut the Tipsify order of the input, every meshlet gets its own so the border vertices are all it costs
+	TEST(Meshlets, KeepTheVertexCacheOrder) {
+		for (NamedMesh& mesh : MakeTestMeshes()) {
+			//like ParseOBJ hands it over
+			Utils::OptimizeVertexCache(mesh.indices, mesh.vertices.size());
+			std::vector<Meshlet> meshlets{};
+			Utils::BuildMeshlets(mesh.vertices, mesh.indices, meshlets);
+
+			//every vertex has to be transformed once, the order only gets to add a little on top of that
+			const float lowerBound{ float(mesh.vertices.size()) / (mesh.indices.size() / 3) };
+			EXPECT_LE(Utils::CalculateACMR(mesh.indices, mesh.vertices.size()), lowerBound + 0.05f) << mesh.name;
+		}
+	}
+
+	//when a meshlet runs out of neighbours it only searches the grid cells around it, so a soup stays linear
+	TEST(Meshlets, DisconnectedMeshScalesLinearly) {
+		auto timeBuild = [](size_t numTriangles) {
+			std::vector<Vertex> vertices{};
+			std::vector<uint32_t> indices{};
+			MakeSoup(numTriangles, vertices, indices);
+			std::vector<Meshlet> meshlets{};
+			const auto start{ std::chrono::steady_clock::now() };
+			Utils::BuildMeshlets(vertices, indices, meshlets);
+			//nothing is shared, so 21 triangles fill the 64 vertices, a few stop early when nothing is left close by
+			EXPECT_GE(meshlets.size(), (numTriangles + 20) / 21);
+			EXPECT_LE(meshlets.size(), (numTriangles + 20) / 21 * 11 / 10);
+			return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		};
+
+		//4 times the triangles: about 4 times as long, a full scan per meshlet would be 16
+		constexpr size_t numTriangles{ 5000 };
+		double smallTime{ DBL_MAX }, bigTime{ DBL_MAX };
+		for (int run{}; run < 3; ++run) {
+			smallTime = std::min(smallTime, timeBuild(numTriangles));
+			bigTime = std::min(bigTime, timeBuild(numTriangles * 4));
+		}
+		EXPECT_LT(bigTime, smallTime * 8.0) << smallTime << "s for " << numTriangles << " triangles, " << bigTime << "s for 4 times that";
+	}
+
+	TEST(LodChain, HalvesTheTrianglesPerLevel) {
+		std::vector<Vertex> vertices{};
+		std::vector<uint32_t> indices{};
+		MakeGrid(64, 64, vertices, indices);
+		constexpr size_t minTriangles{ 64 };
+		std::vector<Mesh> lods{};
+		Utils::BuildLodChain(vertices, indices, lods, minTriangles);
+
+		//a flat grid can collapse all the way: 8192 -> 4096 -> ... -> 64
+		ASSERT_EQ(lods.size(), 7u);
+		size_t previousTriangles{ indices.size() / 3 };
+		float previousError{};
+		for (const Mesh& lod : lods) {
+			const size_t numTriangles{ lod.indices.size() / 3 };
+			//one collapse removes at most two triangles, so it stops right at (or just under) the target
+			EXPECT_LE(numTriangles, previousTriangles / 2);
+			EXPECT_GE(numTriangles + 2, previousTriangles / 2);
+			EXPECT_GE(numTriangles + 2, minTriangles);
+			EXPECT_GE(lod.lodError, previousError);
+			EXPECT_NEAR(lod.lodError, 0.f, 1e-3f); //it stays flat
+			for (uint32_t index : lod.indices) {
+				EXPECT_LT(index, lod.vertices.size());
+			}
+			previousTriangles = numTriangles;
+			previousError = lod.lodError;
+		}
+	}
+
+	TEST(LodChain, ErrorGrowsOnACurvedMesh) {
+		std::vector<Vertex> vertices{};
+		std::vector<uint32_t> indices{};
+		MakeBumpyGrid(48, 48, vertices, indices);
+		std::vector<Mesh> lods{};
+		Utils::BuildLodChain(vertices, indices, lods, 64);
+
+		ASSERT_GE(lods.size(), 3u);
+		float previousError{};
+		size_t previousTriangles{ indices.size() / 3 };
+		for (const Mesh& lod : lods) {
+			EXPECT_LE(lod.indices.size() / 3, previousTriangles / 2);
+			EXPECT_GE(lod.lodError, previousError);
+			previousTriangles = lod.indices.size() / 3;
+			previousError = lod.lodError;
+		}
+		EXPECT_GT(lods.back().lodError, 0.f);
+	}
+
+	TEST(LodChain, EveryLevelIsAValidMesh) {
+		for (const NamedMesh& mesh : MakeTestMeshes()) {
+			std::vector<Mesh> lods{};
+			Utils::BuildLodChain(mesh.vertices, mesh.indices, lods, 64);
+
+			size_t previousTriangles{ mesh.indices.size() / 3 };
+			float previousError{};
+			for (const Mesh& lod : lods) {
+				const size_t numTriangles{ lod.indices.size() / 3 };
+				EXPECT_EQ(lod.indices.size() % 3, 0u) << mesh.name;
+				EXPECT_LE(numTriangles, previousTriangles / 2) << mesh.name;
+				EXPECT_GE(lod.lodError, previousError) << mesh.name;
+				for (uint32_t index : lod.indices) {
+					ASSERT_LT(index, lod.vertices.size()) << mesh.name;
+				}
+				for (const auto& triangle : GetTriangles(lod.indices)) {
+					EXPECT_TRUE(triangle[0] != triangle[1] && triangle[1] != triangle[2] && triangle[2] != triangle[0]) << mesh.name;
+				}
+				previousTriangles = numTriangles;
+				previousError = lod.lodError;
+			}
+		}
+	}
+
+	TEST(LodChain, NothingBelowTheMinimum) {
+		std::vector<Vertex> vertices{};
+		std::vector<uint32_t> indices{};
+		MakeGrid(8, 8, vertices, indices);
+		std::vector<Mesh> lods{};
+
+		//128 triangles, half of that is still 64
+		Utils::BuildLodChain(vertices, indices, lods, 64);
+		EXPECT_EQ(lods.size(), 1u);
+		Utils::BuildLodChain(vertices, indices, lods, 65);
+		EXPECT_TRUE(lods.empty());
+	}
+
+	//--- texture addressing ---
+
+	//the texel a uv lands on before the address mode, like the samplers do it
+	static int ToCoordinate(float uv, int size) {
+		return int(std::floor(uv * size));
+	}
+
+	TEST(AddressTexel, Wrap) {
+		for (int size : { 8, 5 }) {
+			const bool isPowerOfTwo{ size == 8 };
+			auto address = [&](int coordinate) {
+				return isPowerOfTwo ? Texture::AddressTexel<AddressMode::Wrap, true>(coordinate, size) : Texture::AddressTexel<AddressMode::Wrap, false>(coordinate, size);
+			};
+			EXPECT_EQ(address(ToCoordinate(0.f, size)), 0) << size;
+			EXPECT_EQ(address(ToCoordinate(1.f, size)), 0) << size;
+			EXPECT_EQ(address(ToCoordinate(0.999f, size)), size - 1) << size;
+			EXPECT_EQ(address(ToCoordinate(-0.01f, size)), size - 1) << size;
+			EXPECT_EQ(address(ToCoordinate(-1.f, size)), 0) << size;
+			EXPECT_EQ(address(ToCoordinate(2.5f, size)), size / 2) << size;
+			EXPECT_EQ(address(-3 * size + 2), 2) << size;
+		}
+	}
+
+	TEST(AddressTexel, Clamp) {
+		for (int size : { 8, 5 }) {
+			const bool isPowerOfTwo{ size == 8 };
+			auto address = [&](int coordinate) {
+				return isPowerOfTwo ? Texture::AddressTexel<AddressMode::Clamp, true>(coordinate, size) : Texture::AddressTexel<AddressMode::Clamp, false>(coordinate, size);
+			};
+			EXPECT_EQ(address(ToCoordinate(0.f, size)), 0) << size;
+			EXPECT_EQ(address(ToCoordinate(1.f, size)), size - 1) << size;
+			EXPECT_EQ(address(ToCoordinate(-0.01f, size)), 0) << size;
+			EXPECT_EQ(address(ToCoordinate(-7.f, size)), 0) << size;
+			EXPECT_EQ(address(ToCoordinate(3.f, size)), size - 1) << size;
+			EXPECT_EQ(address(1), 1) << size;
+		}
+	}
+
+	TEST(AddressTexel, Mirror) {
+		for (int size : { 8, 5 }) {
+			const bool isPowerOfTwo{ size == 8 };
+			auto address = [&](int coordinate) {
+				return isPowerOfTwo ? Texture::AddressTexel<AddressMode::Mirror, true>(coordinate, size) : Texture::AddressTexel<AddressMode::Mirror, false>(coordinate, size);
+			};
+			//the edge texel repeats once when it turns around, on both sides
+			EXPECT_EQ(address(ToCoordinate(0.f, size)), 0) << size;
+			EXPECT_EQ(address(ToCoordinate(1.f, size)), size - 1) << size;
+			EXPECT_EQ(address(ToCoordinate(-0.01f, size)), 0) << size;
+			EXPECT_EQ(address(ToCoordinate(-1.f, size)), size - 1) << size;
+			EXPECT_EQ(address(ToCoordinate(2.f, size)), 0) << size;
+			EXPECT_EQ(address(size + 1), size - 2) << size;
+			EXPECT_EQ(address(-2), 1) << size;
+		}
+	}
+
+	//the mask version has to give the same texel as the modulo one, also far outside [0, 1]
+	TEST(AddressTexel, PowerOfTwoMatchesGeneric) {
+		for (int size : { 1, 2, 4, 16, 256 }) {
+			for (int coordinate{ -5 * size - 3 }; coordinate <= 5 * size + 3; ++coordinate) {
+				EXPECT_EQ((Texture::AddressTexel<AddressMode::Wrap, true>(coordinate, size)), (Texture::AddressTexel<AddressMode::Wrap, false>(coordinate, size)));
+				EXPECT_EQ((Texture::AddressTexel<AddressMode::Clamp, true>(coordinate, size)), (Texture::AddressTexel<AddressMode::Clamp, false>(coordinate, size)));
+				EXPECT_EQ((Texture::AddressTexel<AddressMode::Mirror, true>(coordinate, size)), (Texture::AddressTexel<AddressMode::Mirror, false>(coordinate, size)));
+			}
+		}
+	}
+
+	//Texture keeps its texels in 4x4 blocks, this gets at them to compare with the row by row surface they came from
+	class TextureTest : public ::testing::Test
+	{
+	protected:
+		using MipLevel = Texture::MipLevel;
+
+		//r and g are the coordinate, b and a tell the sizes apart
+		static uint32_t GetReferenceTexel(int x, int y, int width, int height)
+		{
+			return uint32_t(x) | (uint32_t(y) << 8) | (uint32_t(width) << 16) | (uint32_t(height) << 24);
+		}
+
+		//a row by row image like IMG_Load gives, with no padding to a multiple of the block size
+		static Texture* CreateReferenceTexture(int width, int height)
+		{
+			SDL_Surface* pSurface{ SDL_CreateRGBSurfaceWithFormat(0, width, height, 32, SDL_PIXELFORMAT_ABGR8888) };
+			for (int y{}; y < height; ++y) {
+				uint32_t* pRow{ reinterpret_cast<uint32_t*>(static_cast<uint8_t*>(pSurface->pixels) + y * pSurface->pitch) };
+				for (int x{}; x < width; ++x) {
+					const uint32_t texel{ GetReferenceTexel(x, y, width, height) };
+					pRow[x] = SDL_MapRGBA(pSurface->format, texel & 0xFF, (texel >> 8) & 0xFF, (texel >> 16) & 0xFF, texel >> 24);
+				}
+			}
+			Texture* pTexture{ new Texture{ pSurface } };
+			SDL_FreeSurface(pSurface);
+			return pTexture;
+		}
+
+		static const MipLevel& GetLevel(const Texture& texture, int levelIdx) { return texture.m_MipLevels[levelIdx]; }
+		static size_t GetNumLevels(const Texture& texture) { return texture.m_MipLevels.size(); }
+		static int GetBlocksPerColumn(const MipLevel& level) { return (level.height + Texture::m_BlockSize - 1) / Texture::m_BlockSize; }
+		static uint32_t& GetTexelRef(const MipLevel& level, int x, int y) { return Texture::GetTexelRef(level, x, y); }
+		static const uint32_t* GetBlocksBegin(const MipLevel& level) { return level.pBlocks[0].texels; }
+		static const uint32_t* GetBlocksEnd(const MipLevel& level) { return level.pBlocks[size_t(level.blocksPerRow) * GetBlocksPerColumn(level)].texels; }
+	};
+
+	TEST_F(TextureTest, BlocksMatchTheRowByRowImage) {
+		//partial blocks on the right, the bottom or both, a single partial block, and whole blocks to compare with
+		const std::pair<int, int> sizes[]{ { 5, 3 }, { 6, 7 }, { 13, 9 }, { 3, 2 }, { 1, 1 }, { 17, 4 }, { 4, 10 }, { 8, 8 } };
+		for (const auto& [width, height] : sizes) {
+			SCOPED_TRACE(std::to_string(width) + "x" + std::to_string(height));
+			Texture* pTexture{ CreateReferenceTexture(width, height) };
+			const MipLevel& level{ GetLevel(*pTexture, 0) };
+			ASSERT_EQ(level.width, width);
+			ASSERT_EQ(level.height, height);
+
+			//every texel where the surface had it, each one in its own place inside the blocks
+			std::vector<const uint32_t*> addresses{};
+			for (int y{}; y < height; ++y) {
+				for (int x{}; x < width; ++x) {
+					const uint32_t& texel{ GetTexelRef(level, x, y) };
+					EXPECT_EQ(texel, GetReferenceTexel(x, y, width, height)) << "texel " << x << ", " << y;
+					EXPECT_GE(&texel, GetBlocksBegin(level));
+					EXPECT_LT(&texel, GetBlocksEnd(level));
+					addresses.push_back(&texel);
+				}
+			}
+			std::sort(addresses.begin(), addresses.end());
+			EXPECT_EQ(std::unique(addresses.begin(), addresses.end()), addresses.end());
+
+			//what sampling reads through the blocks is the same texel, point sampling at the texel centers
+			const Vector2 zero{};
+			pTexture->SetAddressMode(AddressMode::Clamp);
+			pTexture->SetSampleMode(SampleMode::Point);
+			for (int y{}; y < height; ++y) {
+				for (int x{}; x < width; ++x) {
+					const Vector2 uv{ (x + 0.5f) / width, (y + 0.5f) / height };
+					const ColorRGBA color{ pTexture->SampleRGBA(uv, zero, zero) };
+					EXPECT_EQ(int(std::round(color.rgb.r * 255.f)), x) << "texel " << x << ", " << y;
+					EXPECT_EQ(int(std::round(color.rgb.g * 255.f)), y) << "texel " << x << ", " << y;
+				}
+			}
+
+			//the next level is built from the blocks too, odd sizes repeat the last row/column
+			if (GetNumLevels(*pTexture) > 1) {
+				const MipLevel& nextLevel{ GetLevel(*pTexture, 1) };
+				for (int y{}; y < nextLevel.height; ++y) {
+					for (int x{}; x < nextLevel.width; ++x) {
+						int sumX{}, sumY{};
+						for (int sampleIdx{}; sampleIdx < 4; ++sampleIdx) {
+							sumX += std::min(x * 2 + sampleIdx % 2, width - 1);
+							sumY += std::min(y * 2 + sampleIdx / 2, height - 1);
+						}
+						const uint32_t expected{ GetReferenceTexel((sumX + 2) / 4, (sumY + 2) / 4, width, height) };
+						EXPECT_EQ(GetTexelRef(nextLevel, x, y), expected) << "level 1 texel " << x << ", " << y;
+					}
+				}
+			}
+			delete pTexture;
+		}
+	}
+
+	TEST(TexturePack, RefusesMissingTextures) {
+		//a texture that failed to load is not the same as asking for a white channel
+		EXPECT_EQ(Texture::Pack({
+			{ nullptr, Texture::Channel::R },
+			{ nullptr, Texture::Channel::One },
+			{ nullptr, Texture::Channel::One },
+			{ nullptr, Texture::Channel::One } }), nullptr);
+		//nothing to take the size from
+		EXPECT_EQ(Texture::Pack({
+			{ nullptr, Texture::Channel::One },
+			{ nullptr, Texture::Channel::One },
+			{ nullptr, Texture::Channel::One },
+			{ nullptr, Texture::Channel::One } }), nullptr);
+	}
 }